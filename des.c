@@ -32,8 +32,13 @@
 #include <assert.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
 
 #define INPUT_FILES_LEN 256
+#define ARG_ENGINE_LEN 16
+#define ARG_TRACE_FORMAT_LEN 8
+#define ARG_MODE_LEN 8
 
 #define KEY_SIZE 8 
 #define KEY_PC1_SIZE 7
@@ -41,6 +46,9 @@
 #define KEY_HEXSTR_LEN (KEY_SIZE * 2)
 #define KEY_ITER_SIZE KEY_PC2_SIZE
 #define KEY_SUBKEYS_NUM 16
+#define KEY_EDE_NUM 3
+#define KEY_EDE_SUBKEYS_NUM (KEY_EDE_NUM * KEY_SUBKEYS_NUM)
+#define KEY_DESX_LINES 3
 
 #define MSG_SINGLE_BLOCK_SIZE 8
 #define MSG_IP_SIZE 8
@@ -51,6 +59,13 @@
 #define MSG_SBOX_SELECTION_SIZE 4
 #define MSG_P_PERMUT_SIZE 4
 
+#define CACHE_LINE_SIZE 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DES_X86
+#include <immintrin.h>
+#endif
+
 #define LOG_KEY_DETAILS
 // #define LOG_KEY_CD_DETAILS
 #define LOG_MSG_DETAILS
@@ -63,6 +78,12 @@
 #define ARG_APP_DECRYPT 0x40
 #define ARG_APP_QUIET   0x20
 #define ARG_APP_NO_ARGS 0x10
+#define ARG_APP_BENCH   0x08
+#define ARG_APP_VERIFY  0x04
+#define ARG_APP_TRACE   0x02
+#define ARG_APP_STREAMS 0x01
+
+#define ARG_JOBS_MAX 256
 
 enum operation
 {
@@ -70,19 +91,122 @@ enum operation
   decrypt
 };
 
+enum cipher_mode
+{
+  mode_ecb = 0,
+  mode_ctr,
+  mode_cbc,
+  mode_ofb,
+  mode_cfb,
+  mode_cfb8
+};
+
+enum trace_format
+{
+  trace_text = 0,
+  trace_binary,
+  trace_jsonl
+};
+
 typedef struct 
 {
   enum operation op;
-  char key_file[INPUT_FILES_LEN];
+  char key_files[KEY_EDE_NUM][INPUT_FILES_LEN];
+  size_t keys_num;
   char data_file[INPUT_FILES_LEN];
   char output_file[INPUT_FILES_LEN];
+  char engine[ARG_ENGINE_LEN];
+  unsigned long verify_sample;
+  unsigned long jobs;
+  unsigned long trace_first;
+  unsigned long trace_last;
+  enum trace_format trace_format;
+  char trace_format_name[ARG_TRACE_FORMAT_LEN];
+  char trace_file[INPUT_FILES_LEN];
+  char sbox_file[INPUT_FILES_LEN];
+  enum cipher_mode mode;
+  char mode_name[ARG_MODE_LEN];
+  char iv_file[INPUT_FILES_LEN];
+  unsigned long offset;
 
   uint8_t flags;
 }app_arg_t;
 
 static app_arg_t g_app_arg;
 
+// set while a traced block or the key goes through the illustrated path in quiet mode
+static int g_trace_active = 0;
+
+/*
+ *
+ *  Structured trace record of one block, the illustrated path state in its
+ *  own byte layout. Only uint8_t members so the binary format is exactly
+ *  this struct, TRACE_RECORD_SIZE bytes, with the block index big endian.
+ *  A binary trace starts with a TRACE_HEADER_SIZE byte header, magic,
+ *  format version, operation and the record size, big endian.
+ *
+ */
+#define TRACE_MAGIC "DESTRACE"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+
+typedef struct
+{
+  uint8_t e[MSG_E_BIT_SIZE];
+  uint8_t ke[MSG_E_BIT_SIZE];
+  uint8_t b[MSG_B_INDICES_SIZE];
+  uint8_t s[MSG_SBOX_SELECTION_SIZE];
+  uint8_t p[MSG_P_PERMUT_SIZE];
+  uint8_t L[MSG_LR_SIZE];
+  uint8_t R[MSG_LR_SIZE];
+} trace_round_t;
+
+typedef struct
+{
+  uint8_t block[8];
+  uint8_t msg[MSG_SINGLE_BLOCK_SIZE];
+  uint8_t subkeys[KEY_SUBKEYS_NUM][KEY_ITER_SIZE];
+  uint8_t ip[MSG_IP_SIZE];
+  uint8_t L0[MSG_LR_SIZE];
+  uint8_t R0[MSG_LR_SIZE];
+  trace_round_t rounds[KEY_SUBKEYS_NUM];
+  uint8_t out[MSG_SINGLE_BLOCK_SIZE];
+} trace_record_t;
+
+#define TRACE_RECORD_SIZE sizeof(trace_record_t)
+
+// set while a traced block goes through the illustrated path into a structured record
+static trace_record_t *g_trace_record = NULL;
+static FILE *g_trace_file = NULL;
+
+/*
+ *
+ *  Everything des_printf and the print_* helpers produce is formatted into
+ *  one reusable buffer and written out with a single fwrite when it fills
+ *  up or before any plain printf, so a traced block costs a few writes
+ *  instead of one vprintf per printed bit.
+ *
+ */
+#define TRACE_BUFF_SIZE (64 * 1024)
+
+static char g_trace_buff[TRACE_BUFF_SIZE];
+static size_t g_trace_len = 0;
+
+// round dumps are printed for traced blocks, the LOG_MSG_LR_* defines print them for every block
+#ifdef LOG_MSG_LR_INTERNAL_DETAILS
+#define LOG_MSG_ROUNDS 1
+#else
+#define LOG_MSG_ROUNDS g_trace_active
+#endif
+
+#ifdef LOG_MSG_LR_DETAILS
+#define LOG_MSG_FINAL_RL 1
+#else
+#define LOG_MSG_FINAL_RL g_trace_active
+#endif
+
 int des_printf(const char *format, ...);
+void trace_flush(void);
 void print_bin_detail(const uint8_t * const buffer, size_t size, size_t bit_word_len, size_t skip_beg);
 void print_bin_with_title(const char *title, const uint8_t * const buffer, size_t size, size_t bit_word_len, size_t skip_beg);
 void print_bin_simple(const char *title, const uint8_t * const buffer, size_t size);
@@ -96,9 +220,23 @@ static app_arg_t arg_process(int argc, char **argv)
 {
   app_arg_t ret = {
     .op = encrypt,
-    .key_file = {0},
+    .key_files = {{0}},
+    .keys_num = 0,
     .data_file = {0},
     .output_file = {0},
+    .engine = {0},
+    .verify_sample = 0,
+    .jobs = 1,
+    .trace_first = 0,
+    .trace_last = 0,
+    .trace_format = trace_text,
+    .trace_format_name = {0},
+    .trace_file = {0},
+    .sbox_file = {0},
+    .mode = mode_ecb,
+    .mode_name = {0},
+    .iv_file = {0},
+    .offset = 0,
     
     .flags = 0x00
   };
@@ -140,9 +278,15 @@ static app_arg_t arg_process(int argc, char **argv)
     }
     else if(strcmp(param, "-k") == 0 && i+1 < argc)
     {
-      char *key_ptr = argv[i+1];
-      for(int idx = 0; key_ptr && *key_ptr && i < INPUT_FILES_LEN; ++idx, ++key_ptr)
-        ret.key_file[idx] = *key_ptr;
+      // repeated for 3DES, surplus ones are only counted so arg_valid can complain
+      if(ret.keys_num < KEY_EDE_NUM)
+      {
+        char *key_ptr = argv[i+1];
+        for(int idx = 0; key_ptr && *key_ptr && i < INPUT_FILES_LEN; ++idx, ++key_ptr)
+          ret.key_files[ret.keys_num][idx] = *key_ptr;
+      }
+
+      ++ret.keys_num;
     }
     else if(strcmp(param, "-o") == 0 && i+1 < argc)
     {
@@ -154,6 +298,98 @@ static app_arg_t arg_process(int argc, char **argv)
     {
       ret.flags |= ARG_APP_QUIET;
     }
+    else if(strcmp(param, "--bench") == 0)
+    {
+      ret.flags |= ARG_APP_BENCH | ARG_APP_QUIET;
+    }
+    else if(strcmp(param, "--verify-sample") == 0 && i+1 < argc)
+    {
+      ret.flags |= ARG_APP_VERIFY;
+      ret.verify_sample = strtoul(argv[i+1], NULL, 10);
+    }
+    else if(strcmp(param, "--trace-block") == 0 && i+1 < argc)
+    {
+      ret.flags |= ARG_APP_TRACE | ARG_APP_QUIET;
+      ret.trace_first = ret.trace_last = strtoul(argv[i+1], NULL, 10);
+    }
+    else if(strcmp(param, "--trace-range") == 0 && i+1 < argc)
+    {
+      ret.flags |= ARG_APP_TRACE | ARG_APP_QUIET;
+      if(sscanf(argv[i+1], "%lu:%lu", &ret.trace_first, &ret.trace_last) != 2)
+        ret.trace_first = ret.trace_last + 1;
+    }
+    else if(strcmp(param, "--trace-format") == 0 && i+1 < argc)
+    {
+      char *format_ptr = argv[i+1];
+      for(int idx = 0; format_ptr && *format_ptr && idx < ARG_TRACE_FORMAT_LEN - 1; ++idx, ++format_ptr)
+        ret.trace_format_name[idx] = *format_ptr;
+    }
+    else if(strcmp(param, "--trace-out") == 0 && i+1 < argc)
+    {
+      char *trace_file_ptr = argv[i+1];
+      for(int idx = 0; trace_file_ptr && *trace_file_ptr && idx < INPUT_FILES_LEN - 1; ++idx, ++trace_file_ptr)
+        ret.trace_file[idx] = *trace_file_ptr;
+    }
+    else if(strcmp(param, "--mode") == 0 && i+1 < argc)
+    {
+      char *mode_ptr = argv[i+1];
+      for(int idx = 0; mode_ptr && *mode_ptr && idx < ARG_MODE_LEN - 1; ++idx, ++mode_ptr)
+        ret.mode_name[idx] = *mode_ptr;
+    }
+    else if(strcmp(param, "--iv") == 0 && i+1 < argc)
+    {
+      char *iv_file_ptr = argv[i+1];
+      for(int idx = 0; iv_file_ptr && *iv_file_ptr && idx < INPUT_FILES_LEN - 1; ++idx, ++iv_file_ptr)
+        ret.iv_file[idx] = *iv_file_ptr;
+    }
+    else if(strcmp(param, "--streams") == 0)
+    {
+      ret.flags |= ARG_APP_STREAMS;
+    }
+    else if(strcmp(param, "--offset") == 0 && i+1 < argc)
+    {
+      ret.offset = strtoul(argv[i+1], NULL, 10);
+    }
+    else if(strcmp(param, "-j") == 0 && i+1 < argc)
+    {
+      ret.jobs = strtoul(argv[i+1], NULL, 10);
+    }
+    else if(strcmp(param, "--sbox-file") == 0 && i+1 < argc)
+    {
+      char *sbox_file_ptr = argv[i+1];
+      for(int idx = 0; sbox_file_ptr && *sbox_file_ptr && idx < INPUT_FILES_LEN - 1; ++idx, ++sbox_file_ptr)
+        ret.sbox_file[idx] = *sbox_file_ptr;
+    }
+    else if(strcmp(param, "--engine") == 0 && i+1 < argc)
+    {
+      char *engine_ptr = argv[i+1];
+      for(int idx = 0; engine_ptr && *engine_ptr && idx < ARG_ENGINE_LEN - 1; ++idx, ++engine_ptr)
+        ret.engine[idx] = *engine_ptr;
+    }
+  }
+
+  if(strcmp(ret.trace_format_name, "binary") == 0)
+    ret.trace_format = trace_binary;
+  else if(strcmp(ret.trace_format_name, "jsonl") == 0)
+    ret.trace_format = trace_jsonl;
+
+  if(strcmp(ret.mode_name, "ctr") == 0)
+    ret.mode = mode_ctr;
+  else if(strcmp(ret.mode_name, "cbc") == 0)
+    ret.mode = mode_cbc;
+  else if(strcmp(ret.mode_name, "ofb") == 0)
+    ret.mode = mode_ofb;
+  else if(strcmp(ret.mode_name, "cfb") == 0)
+    ret.mode = mode_cfb;
+  else if(strcmp(ret.mode_name, "cfb8") == 0)
+    ret.mode = mode_cfb8;
+
+  // structured traces are meant for tooling, without a range every block goes in
+  if(ret.trace_format != trace_text && !(ret.flags & ARG_APP_TRACE))
+  {
+    ret.flags |= ARG_APP_TRACE | ARG_APP_QUIET;
+    ret.trace_first = 0;
+    ret.trace_last = (unsigned long)-1;
   }
 
   return ret;
@@ -176,18 +412,84 @@ static int arg_valid(app_arg_t args)
     return 0;
   }
 
-  if(!*args.key_file)
+  if(!args.keys_num)
   {
     printf("-k (key file) not specified!\n\n");
     return 0;
   } 
 
+  if(args.keys_num > KEY_EDE_NUM)
+  {
+    printf("-k (key file) can be given at most 3 times!\n\n");
+    return 0;
+  }
+
+  if(args.keys_num > 1 && args.trace_format != trace_text)
+  {
+    printf("--trace-format binary and jsonl records hold a single DES key, 3DES can only be traced as text!\n\n");
+    return 0;
+  }
+
   if(!*args.data_file)
   {
     printf("-f (data file) not specified!\n\n");
     return 0;
   }
 
+  if(args.flags & ARG_APP_TRACE && args.trace_first > args.trace_last)
+  {
+    printf("--trace-range needs FIRST:LAST block indices with FIRST <= LAST!\n\n");
+    return 0;
+  }
+
+  if(*args.trace_format_name && args.trace_format == trace_text && strcmp(args.trace_format_name, "text") != 0)
+  {
+    printf("--trace-format needs to be text, binary or jsonl!\n\n");
+    return 0;
+  }
+
+  if(args.flags & ARG_APP_VERIFY && !args.verify_sample)
+  {
+    printf("--verify-sample needs a positive block count!\n\n");
+    return 0;
+  }
+
+  if(*args.mode_name && args.mode == mode_ecb && strcmp(args.mode_name, "ecb") != 0)
+  {
+    printf("--mode needs to be ecb, ctr, cbc, ofb, cfb or cfb8!\n\n");
+    return 0;
+  }
+
+  if(args.flags & ARG_APP_STREAMS && args.mode != mode_cbc)
+  {
+    printf("--streams interleaves CBC chains, it needs --mode cbc!\n\n");
+    return 0;
+  }
+
+  if(args.flags & ARG_APP_STREAMS && args.flags & ARG_APP_TRACE)
+  {
+    printf("--streams can't be traced, blocks of different files go through the engines together!\n\n");
+    return 0;
+  }
+
+  if(args.mode != mode_ecb && !(args.flags & ARG_APP_STREAMS) && !*args.iv_file)
+  {
+    printf("--iv (IV file) needed by --mode %s!\n\n", args.mode_name);
+    return 0;
+  }
+
+  if(args.offset && args.mode != mode_ctr)
+  {
+    printf("--offset is only meaningful with --mode ctr!\n\n");
+    return 0;
+  }
+
+  if(!args.jobs || args.jobs > ARG_JOBS_MAX)
+  {
+    printf("-j needs a thread count from 1 to %d!\n\n", ARG_JOBS_MAX);
+    return 0;
+  }
+
   return 1;
 }
 
@@ -196,38 +498,59 @@ static void usage(void)
   printf("des_illustrated [-e or -d] <data file> -k <key file> [OPTIONS] \n\n");
   printf("\t-e encrypt file\n");
   printf("\t-d decrypt file\n");
-  printf("\t-k key file in hex string format\n");
+  printf("\t-k key file in hex string format, given two or three times for 3DES EDE2 or EDE3,\n");
+  printf("\t   a key file with K, K1 and K2 on three lines is DESX with K1, K2 the whitening keys\n");
   printf("\t-o <optional> output file to save the result\n");
-  printf("\t-q <optional> quiet mode - no console output except in case of errors\n");
+  printf("\t-q <optional> quiet mode - no console output except in case of errors,\n");
+  printf("\t   blocks go through the word engine instead of the illustrated one\n");
+  printf("\t--engine <optional> force the engine, one of avx512, avx2, bs64, gather, table4, pair4, table, reference,\n");
+  printf("\t   by default the fastest one the CPU supports is used in quiet mode\n");
+  printf("\t--verify-sample <optional> N, every Nth block is also run through the reference engine,\n");
+  printf("\t   on mismatch the job is aborted with the block index\n");
+  printf("\t--trace-block <optional> N, only block N goes through the illustrated path with round dumps,\n");
+  printf("\t   every other block through the fast engines without output, implies -q\n");
+  printf("\t--trace-range <optional> FIRST:LAST, same for the inclusive range of blocks\n");
+  printf("\t--trace-format <optional> text (default), binary or jsonl, the last two write one structured record\n");
+  printf("\t   per traced block with subkeys, IP and the state of every round, all blocks unless a trace range is given\n");
+  printf("\t--trace-out <optional> file for binary or jsonl trace records, standard output by default\n");
+  printf("\t--mode <optional> ecb (default, zero padded), ctr, counter mode with the output as long as the input,\n");
+  printf("\t   or cbc, zero padded as ecb, serial encryption and decryption through the batch engines and -j threads,\n");
+  printf("\t   ofb with the keystream computed ahead on a helper thread, cfb (64 bit feedback, decryption through the batch\n");
+  printf("\t   engines and -j threads) or cfb8 (8 bit feedback), the last three with the output as long as the input\n");
+  printf("\t--iv <optional> IV file in the key file format, the initial 64 bit big endian counter for ctr\n");
+  printf("\t--streams <optional> with cbc the data file lists independent streams, '<data file> <output file> <IV hex>'\n");
+  printf("\t   per line, their chains are interleaved through the batch engines, -o and --iv are not used\n");
+  printf("\t--offset <optional> N, ctr data starts at byte N of the stream, any part of it can be processed alone\n");
+  printf("\t-j <optional> N, whole blocks are split in N chunks encrypted by N threads, fast engines only\n");
+  printf("\t--bench <optional> time every engine the CPU supports on the data file instead of writing it,\n");
+  printf("\t   then IP and IP^-1 through compiled tables and through delta swaps\n");
+  printf("\t--sbox-file <optional> file with 8 * 64 decimal S-box entries, S1 to S8 row by row, replacing the DES ones\n");
 }
+// subkeys live inline, a key schedule never touches the heap
 typedef struct 
 {
-  uint8_t *subkeys;
+  uint8_t subkeys[KEY_SUBKEYS_NUM * KEY_ITER_SIZE];
 } key_rotation_t;
 
 typedef struct 
 {
-  uint8_t *ptr;
+  const uint8_t *ptr;
   size_t size;
   size_t it;
 
 } key_subkey_t;
 
-static key_rotation_t init_key_rot(void)
+// key rotations of a job, the third one is the first one again for EDE2
+typedef struct
 {
-  key_rotation_t ret;
-  ret.subkeys = (uint8_t*)malloc(KEY_SUBKEYS_NUM * KEY_ITER_SIZE * sizeof *ret.subkeys);
-
-  return ret;
-}
+  key_rotation_t rots[KEY_EDE_NUM];
+  size_t num;
 
-static void free_key_rot(key_rotation_t key_rot)
-{
-  if(key_rot.subkeys)
-    free(key_rot.subkeys);
-}
+  // DESX input and output whitening, indexed with enum operation, zero for plain DES
+  uint8_t whiten[2][2][KEY_SIZE];
+} key_set_t;
 
-static key_subkey_t key_get_subkey(key_rotation_t key_rot, size_t iteration)
+static key_subkey_t key_get_subkey(const key_rotation_t * const key_rot, size_t iteration)
 {
   if(!iteration || iteration > KEY_SUBKEYS_NUM)
   {
@@ -237,7 +560,7 @@ static key_subkey_t key_get_subkey(key_rotation_t key_rot, size_t iteration)
 
   const key_subkey_t it = 
   {
-    .ptr = key_rot.subkeys + ((iteration - 1) * KEY_ITER_SIZE),
+    .ptr = key_rot->subkeys + ((iteration - 1) * KEY_ITER_SIZE),
     .size = KEY_ITER_SIZE,
     .it = iteration
   };
@@ -245,7 +568,7 @@ static key_subkey_t key_get_subkey(key_rotation_t key_rot, size_t iteration)
   return it;
 }
 
-static key_subkey_t key_get_subkey_reverse(key_rotation_t key_rot, size_t iteration)
+static key_subkey_t key_get_subkey_reverse(const key_rotation_t * const key_rot, size_t iteration)
 {
   if(!iteration || iteration > KEY_SUBKEYS_NUM)
   {
@@ -257,7 +580,7 @@ static key_subkey_t key_get_subkey_reverse(key_rotation_t key_rot, size_t iterat
 
   const key_subkey_t it = 
   {
-    .ptr = key_rot.subkeys + (idx * KEY_ITER_SIZE),
+    .ptr = key_rot->subkeys + (idx * KEY_ITER_SIZE),
     .size = KEY_ITER_SIZE,
     .it = idx + 1
   };
@@ -265,7 +588,7 @@ static key_subkey_t key_get_subkey_reverse(key_rotation_t key_rot, size_t iterat
   return it;
 }
 
-typedef key_subkey_t(*key_get_iterator)(key_rotation_t, size_t);
+typedef key_subkey_t(*key_get_iterator)(const key_rotation_t *, size_t);
 
 static key_get_iterator key_get_iterator_function(enum operation op)
 {
@@ -282,14 +605,14 @@ static int key_is_iterator_valid(key_subkey_t it)
   return it.ptr != NULL && it.size == KEY_ITER_SIZE;
 }
 
-static void key_add_subkey(key_rotation_t key_rot, size_t subkey_num, uint8_t *key_pc2)
+static void key_add_subkey(key_rotation_t *key_rot, size_t subkey_num, uint8_t *key_pc2)
 {
   assert(subkey_num >= 1 && subkey_num <= KEY_SUBKEYS_NUM);
 
-  memcpy(key_rot.subkeys + ((subkey_num - 1) * KEY_ITER_SIZE), key_pc2, KEY_ITER_SIZE);
+  memcpy(key_rot->subkeys + ((subkey_num - 1) * KEY_ITER_SIZE), key_pc2, KEY_ITER_SIZE);
 }
 
-static void key_rotation_print(const key_rotation_t key_rot)
+static void key_rotation_print(const key_rotation_t * const key_rot)
 {
   size_t idx = 1;
   key_subkey_t it = key_get_subkey(key_rot, idx);
@@ -311,19 +634,83 @@ static long file_get_size(FILE *file)
   return ret;
 }
 
-static unsigned long file_read_all(const char * const filename, char **ret)
+static unsigned long file_size_of(const char * const filename)
 {
   FILE *file = fopen(filename, "r");
   if(!file)
     return 0;
 
   const long file_size = file_get_size(file);
-  if(!file_size)
+  fclose(file);
+
+  return file_size > 0 ? (unsigned long)file_size : 0;
+}
+
+/*
+ *
+ *  Every working buffer of a run is carved out of one arena, sized at startup
+ *  from the input files and allocated with a single malloc. Nothing is handed
+ *  back until the run ends, so the arena removes the per-block and per-chunk
+ *  malloc/free calls. stdio, pthread_create and qsort may still allocate.
+ *
+ */
+
+#define ARENA_ALIGN 64
+#define ARENA_IO_BUFF_SIZE (1 << 16)
+
+typedef struct
+{
+  uint8_t *base;
+  size_t size;
+  size_t used;
+} arena_t;
+
+static size_t arena_round(size_t size)
+{
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static int arena_init(arena_t *arena, size_t size)
+{
+  arena->base = (uint8_t*)malloc(size);
+  arena->size = arena->base ? size : 0;
+  arena->used = 0;
+
+  return arena->base != NULL;
+}
+
+static void *arena_alloc(arena_t *arena, size_t size)
+{
+  const size_t offset = arena_round((size_t)(uintptr_t)(arena->base + arena->used)) - (size_t)(uintptr_t)arena->base;
+  if(offset > arena->size || size > arena->size - offset)
+    return NULL;
+
+  arena->used = offset + size;
+  return arena->base + offset;
+}
+
+static void arena_release(arena_t *arena)
+{
+  free(arena->base);
+  memset(arena, 0x00, sizeof *arena);
+}
+
+static unsigned long file_read_all(const char * const filename, arena_t *arena, char **ret)
+{
+  FILE *file = fopen(filename, "r");
+  if(!file)
     return 0;
 
-  *ret = (char*)malloc(sizeof(char) * (unsigned long)file_size);
-  if(!ret)
+  // straight into the arena, stdio doesn't get to allocate its own buffer
+  setvbuf(file, NULL, _IONBF, 0);
+
+  const long file_size = file_get_size(file);
+  *ret = file_size > 0 ? (char*)arena_alloc(arena, (size_t)file_size) : NULL;
+  if(!*ret)
+  {
+    fclose(file);
     return 0;
+  }
 
   const unsigned long actual_size = fread(*ret, 1, (unsigned long)file_size, file);
   des_printf("%s read size %lu buff size %lu\n", filename, actual_size, file_size); 
@@ -427,7 +814,7 @@ static void key_pc1(const uint8_t * const buffer, uint8_t *ret)
   ret[0] |= buffer[GET_BYTE_IDX(9)]  >> 6 & 0x02;
  
   ret[0] |= buffer[GET_BYTE_IDX(1)]  >> 7 & 0x01;
-  ret[1] |= buffer[GET_BYTE_IDX(58)] << 2 & 0x80;
+  ret[1] |= buffer[GET_BYTE_IDX(58)] << 1 & 0x80;
   ret[1] |= buffer[GET_BYTE_IDX(50)]      & 0x40;
   ret[1] |= buffer[GET_BYTE_IDX(42)] >> 1 & 0x20;
   ret[1] |= buffer[GET_BYTE_IDX(34)] >> 2 & 0x10;
@@ -436,7 +823,7 @@ static void key_pc1(const uint8_t * const buffer, uint8_t *ret)
 
   ret[1] |= buffer[GET_BYTE_IDX(10)] >> 5 & 0x02;
   ret[1] |= buffer[GET_BYTE_IDX(2)]  >> 6 & 0x01;
-  ret[2] |= buffer[GET_BYTE_IDX(59)] << 1 & 0x80;
+  ret[2] |= buffer[GET_BYTE_IDX(59)] << 2 & 0x80;
   ret[2] |= buffer[GET_BYTE_IDX(51)] << 1 & 0x40;
   ret[2] |= buffer[GET_BYTE_IDX(43)]      & 0x20;
   ret[2] |= buffer[GET_BYTE_IDX(35)] >> 1 & 0x10;
@@ -618,9 +1005,7 @@ static key_rotation_t key_rotation(const uint8_t * const key_pc1_buffer)
   print_bin_with_title("D0 = ", d_i, 4, 7, 4);
 #endif
 
-  key_rotation_t ret_subkeys = init_key_rot();
-  if(!ret_subkeys.subkeys)
-    return ret_subkeys;
+  key_rotation_t ret_subkeys;
  
   for(size_t i = 1; i <= 16; ++i)
   {
@@ -680,7 +1065,7 @@ static key_rotation_t key_rotation(const uint8_t * const key_pc1_buffer)
     memset(title_str, 0x00, sizeof title_str);
 #endif
 #endif
-    key_add_subkey(ret_subkeys, i, K_pc2);
+    key_add_subkey(&ret_subkeys, i, K_pc2);
   } 
 
   return ret_subkeys; 
@@ -943,7 +1328,8 @@ static void msg_ebit_selection(const uint8_t * const R, uint8_t *ret)
   ret[5] |= R[GET_BYTE_IDX(1) ] >> 7 & 0x01;
 }
 
-static const uint8_t g_sboxes[8][64] = {
+// replaceable with --sbox-file before any engine table is built from it
+static uint8_t g_sboxes[8][64] = {
 
   /* S1 */
   {
@@ -1010,6 +1396,46 @@ static const uint8_t g_sboxes[8][64] = {
   }
 };
 
+static int msg_sbox_load(const char * const buffer, size_t size)
+{
+  /*
+   *
+   *  S-box file is 8 * 64 decimal numbers from 0 to 15 separated by white
+   *  space or commas, S1 to S8 row by row as in g_sboxes. Nothing is
+   *  replaced unless the whole file is valid.
+   *
+   */
+
+  uint8_t sboxes[8][64];
+  size_t count = 0;
+  for(size_t i = 0; i < size;)
+  {
+    if(isspace((unsigned char)buffer[i]) || buffer[i] == ',')
+    {
+      ++i;
+      continue;
+    }
+
+    unsigned int value = 0;
+    size_t digits = 0;
+    for(; i < size && isdigit((unsigned char)buffer[i]) && digits < 3; ++i, ++digits)
+      value = value * 10 + (unsigned int)(buffer[i] - '0');
+
+    if(!digits || value > 15 || count == sizeof sboxes || (i < size && isdigit((unsigned char)buffer[i])))
+      return 0;
+
+    sboxes[count / 64][count % 64] = (uint8_t)value;
+    ++count;
+  }
+
+  if(count != sizeof sboxes)
+    return 0;
+
+  memcpy(g_sboxes, sboxes, sizeof g_sboxes);
+
+  return 1;
+}
+
 static void msg_calc_b_indices(const uint8_t * const e_bit_key_xored, size_t key_xored_size, uint8_t *retB)
 {
   /*
@@ -1152,7 +1578,7 @@ static void msg_p_permut(const uint8_t * const sbox_result, uint8_t *ret)
   ret[3] |= sbox_result[GET_BYTE_IDX(25)] >> 7 & 0x01;
 }
 
-static void msg_calc_Rn(const uint8_t * const L, const uint8_t * const R, key_subkey_t key_rot, uint8_t *out_R)
+static void msg_calc_Rn(const uint8_t * const L, const uint8_t * const R, key_subkey_t key_rot, trace_round_t *trace_round, int illustrated, uint8_t *out_R)
 {
   uint8_t e_bit[MSG_E_BIT_SIZE] = {0};
   msg_ebit_selection(R, e_bit);
@@ -1198,23 +1624,33 @@ static void msg_calc_Rn(const uint8_t * const L, const uint8_t * const R, key_su
   for(size_t i = 0; i < MSG_P_PERMUT_SIZE && i < MSG_LR_SIZE; ++i)
     out_R[i] = L[i] ^ p_permut[i];
 
-#ifdef LOG_MSG_LR_INTERNAL_DETAILS
-  const size_t num = key_rot.it;
-  char title_str[10 + 1] = {0};
-  sprintf(title_str, "E%zu = ", num);
-  print_bin_with_title(title_str, e_bit, MSG_E_BIT_SIZE, 6, 0);
+  if(trace_round)
+  {
+    memcpy(trace_round->e, e_bit, MSG_E_BIT_SIZE);
+    memcpy(trace_round->ke, e_bit_key_xored, MSG_E_BIT_SIZE);
+    memcpy(trace_round->b, b_indices, MSG_B_INDICES_SIZE);
+    memcpy(trace_round->s, sbox_selection, MSG_SBOX_SELECTION_SIZE);
+    memcpy(trace_round->p, p_permut, MSG_P_PERMUT_SIZE);
+  }
+
+  if(LOG_MSG_ROUNDS && illustrated)
+  {
+    const size_t num = key_rot.it;
+    char title_str[10 + 1] = {0};
+    sprintf(title_str, "E%zu = ", num);
+    print_bin_with_title(title_str, e_bit, MSG_E_BIT_SIZE, 6, 0);
 
-  memset(title_str, 0x00, 10 + 1);
-  sprintf(title_str, "K%zuE%zu = ", key_rot.it, num);
-  print_bin_with_title(title_str, e_bit_key_xored, MSG_E_BIT_SIZE, 6, 0);
+    memset(title_str, 0x00, 10 + 1);
+    sprintf(title_str, "K%zuE%zu = ", key_rot.it, num);
+    print_bin_with_title(title_str, e_bit_key_xored, MSG_E_BIT_SIZE, 6, 0);
 
-  memset(title_str, 0x00, 10 + 1);
-  sprintf(title_str, "B%zu = ", key_rot.it);
-  print_bin_with_title(title_str, b_indices, MSG_B_INDICES_SIZE, 8, 0);
+    memset(title_str, 0x00, 10 + 1);
+    sprintf(title_str, "B%zu = ", key_rot.it);
+    print_bin_with_title(title_str, b_indices, MSG_B_INDICES_SIZE, 8, 0);
 
-  print_bin_with_title("S(B) = ", sbox_selection, MSG_SBOX_SELECTION_SIZE, 4, 0);
-  print_bin_with_title("P(S) = ", p_permut, MSG_P_PERMUT_SIZE, 4, 0);
-#endif
+    print_bin_with_title("S(B) = ", sbox_selection, MSG_SBOX_SELECTION_SIZE, 4, 0);
+    print_bin_with_title("P(S) = ", p_permut, MSG_P_PERMUT_SIZE, 4, 0);
+  }
 }
 
 static void msg_combine_final_RL(const uint8_t * const L, const uint8_t * const R, uint8_t *final_RL)
@@ -1223,47 +1659,70 @@ static void msg_combine_final_RL(const uint8_t * const L, const uint8_t * const
   memcpy(final_RL + MSG_LR_SIZE, L, MSG_LR_SIZE);
 }
 
-static void msg_single_block(const uint8_t * const msg_single_block, key_rotation_t key_rot, enum operation op, uint8_t *out_single_block)
+static void msg_crypt_block(const uint8_t * const msg_single_block, const key_rotation_t * const key_rot, enum operation op, trace_record_t *trace_record, int illustrated, uint8_t *out_single_block)
 {
+  // the record and the console output are optional, without both nothing outside out_single_block is touched
+
   uint8_t msg_ip_buff[MSG_IP_SIZE] = {0};
   msg_ip(msg_single_block, msg_ip_buff);
 
   uint8_t L[MSG_LR_SIZE] = {0}, R[MSG_LR_SIZE] = {0};
   msg_get_LR(msg_ip_buff, L, R);
 
+  if(trace_record)
+  {
+    memcpy(trace_record->msg, msg_single_block, MSG_SINGLE_BLOCK_SIZE);
+    memcpy(trace_record->subkeys, key_rot->subkeys, sizeof trace_record->subkeys);
+    memcpy(trace_record->ip, msg_ip_buff, MSG_IP_SIZE);
+    memcpy(trace_record->L0, L, MSG_LR_SIZE);
+    memcpy(trace_record->R0, R, MSG_LR_SIZE);
+  }
+
 #ifdef LOG_MSG_DETAILS
-  print_as_hexstr_with_title("M  = ", msg_single_block, MSG_SINGLE_BLOCK_SIZE);
-  print_bin_with_title("M  = ", msg_single_block, MSG_SINGLE_BLOCK_SIZE, 4, 0);
-  print_bin_with_title("IP = ", msg_ip_buff, MSG_IP_SIZE, 4, 0);
+  if(illustrated)
+  {
+    print_as_hexstr_with_title("M  = ", msg_single_block, MSG_SINGLE_BLOCK_SIZE);
+    print_bin_with_title("M  = ", msg_single_block, MSG_SINGLE_BLOCK_SIZE, 4, 0);
+    print_bin_with_title("IP = ", msg_ip_buff, MSG_IP_SIZE, 4, 0);
+  }
 #endif
 
-#ifdef LOG_MSG_LR_INTERNAL_DETAILS 
-  print_bin_with_title("L0 = ", L, MSG_LR_SIZE, 4, 0); 
-  print_bin_with_title("R0 = ", R, MSG_LR_SIZE, 4, 0);
-  des_printf("\n"); 
-#endif
+  if(LOG_MSG_ROUNDS && illustrated)
+  {
+    print_bin_with_title("L0 = ", L, MSG_LR_SIZE, 4, 0); 
+    print_bin_with_title("R0 = ", R, MSG_LR_SIZE, 4, 0);
+    des_printf("\n"); 
+  }
 
   key_get_iterator key_iterator = key_get_iterator_function(op);
   
   uint8_t Rn[MSG_LR_SIZE] = {0};
   for(size_t i=1; i <= 16; ++i)
   {
-    msg_calc_Rn(L, R, key_iterator(key_rot, i), Rn);
+    trace_round_t * const trace_round = trace_record ? &trace_record->rounds[i - 1] : NULL;
+    msg_calc_Rn(L, R, key_iterator(key_rot, i), trace_round, illustrated, Rn);
 
     msg_copy_LR(R, L);
     msg_copy_LR(Rn, R);
 
-#ifdef LOG_MSG_LR_INTERNAL_DETAILS
-    char title_str[10 + 1] = {0};
-    sprintf(title_str, "L%zu = ", i);
-    print_bin_with_title(title_str, L, MSG_LR_SIZE, 4, 0);
+    if(trace_round)
+    {
+      memcpy(trace_round->L, L, MSG_LR_SIZE);
+      memcpy(trace_round->R, R, MSG_LR_SIZE);
+    }
+
+    if(LOG_MSG_ROUNDS && illustrated)
+    {
+      char title_str[10 + 1] = {0};
+      sprintf(title_str, "L%zu = ", i);
+      print_bin_with_title(title_str, L, MSG_LR_SIZE, 4, 0);
    
-    memset(title_str, 0x00, 10 + 1);
-    sprintf(title_str, "R%zu = ", i);
-    print_bin_with_title(title_str, R, MSG_LR_SIZE, 4, 0);
+      memset(title_str, 0x00, 10 + 1);
+      sprintf(title_str, "R%zu = ", i);
+      print_bin_with_title(title_str, R, MSG_LR_SIZE, 4, 0);
 
-    des_printf("\n");
-#endif
+      des_printf("\n");
+    }
   }
 
   uint8_t final_RL[MSG_SINGLE_BLOCK_SIZE] = {0};
@@ -1271,98 +1730,3017 @@ static void msg_single_block(const uint8_t * const msg_single_block, key_rotatio
 
   msg_ip_reverse(final_RL, out_single_block);
 
-#ifdef LOG_MSG_LR_DETAILS
-  print_bin_8bit("R16L16 = ", final_RL, MSG_SINGLE_BLOCK_SIZE);
-#endif
+  if(trace_record)
+    memcpy(trace_record->out, out_single_block, MSG_SINGLE_BLOCK_SIZE);
+
+  if(LOG_MSG_FINAL_RL && illustrated)
+    print_bin_8bit("R16L16 = ", final_RL, MSG_SINGLE_BLOCK_SIZE);
 
 #ifdef LOG_MSG_DETAILS
-  print_bin_8bit("IP-1 = ", out_single_block, MSG_SINGLE_BLOCK_SIZE); 
-  print_as_hexstr_with_title("Cipher = ", out_single_block, MSG_SINGLE_BLOCK_SIZE);
-  des_printf("\n");
+  if(illustrated)
+  {
+    print_bin_8bit("IP-1 = ", out_single_block, MSG_SINGLE_BLOCK_SIZE); 
+    print_as_hexstr_with_title("Cipher = ", out_single_block, MSG_SINGLE_BLOCK_SIZE);
+    des_printf("\n");
+  }
 #endif
 
 }
 
-int main(int argc, char **argv)
+static void msg_single_block(const uint8_t * const msg_single_block, const key_rotation_t * const key_rot, enum operation op, uint8_t *out_single_block)
 {
-  g_app_arg = arg_process(argc, argv);
-  if(!arg_valid(g_app_arg))
-  {
-    usage();
-    return 0;
-  }
- 
-  char *key_file_buffer = NULL;
-  const unsigned long key_file_size = file_read_all(g_app_arg.key_file, &key_file_buffer);
-  if(!key_file_size || !key_file_buffer)
+  msg_crypt_block(msg_single_block, key_rot, op, g_trace_record, 1, out_single_block);
+}
+
+static void msg_reference_block(const uint8_t * const msg_single_block, const key_rotation_t * const key_rot, enum operation op, uint8_t *out_single_block)
+{
+  // same path without trace record or output, safe on the job threads
+
+  msg_crypt_block(msg_single_block, key_rot, op, NULL, 0, out_single_block);
+}
+
+typedef void (*msg_block_fn)(const uint8_t * const, const key_rotation_t * const, enum operation, uint8_t *);
+
+static void msg_ede_crypt(const uint8_t * const msg_single_block_buff, const key_set_t * const key_set, enum operation op, msg_block_fn block_fn, uint8_t *out_single_block)
+{
+  // 3DES encrypts as E K1, D K2, E K3 and decrypts as D K3, E K2, D K1, DESX whitens around DES
+
+  if(key_set->num == 1)
   {
-    printf("Error reading key '%s' file size '%lu'\n", g_app_arg.key_file, key_file_size);
-    goto key_end;
+    uint8_t block[MSG_SINGLE_BLOCK_SIZE];
+    for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+      block[i] = msg_single_block_buff[i] ^ key_set->whiten[op][0][i];
+
+    block_fn(block, &key_set->rots[0], op, out_single_block);
+    for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+      out_single_block[i] ^= key_set->whiten[op][1][i];
+
+    return;
   }
 
-  // ------------------------------  + 1 cause line feed
-  if(key_file_size != KEY_HEXSTR_LEN + 1)
+  const key_rotation_t * const k3 = &key_set->rots[key_set->num == KEY_EDE_NUM ? 2 : 0];
+  const key_rotation_t * const stages[2][KEY_EDE_NUM] =
   {
-    printf("key file size is required to be hex string consisting 16 character\n");
-    goto key_end;
-  }
+    { &key_set->rots[0], &key_set->rots[1], k3 },
+    { k3, &key_set->rots[1], &key_set->rots[0] }
+  };
 
-  if(!is_valid_hex_str(key_file_buffer, KEY_HEXSTR_LEN))
+  uint8_t block[MSG_SINGLE_BLOCK_SIZE];
+  memcpy(block, msg_single_block_buff, MSG_SINGLE_BLOCK_SIZE);
+  for(size_t stage = 0; stage < KEY_EDE_NUM; ++stage)
   {
-    printf("%s does not contain valid hex str\n", g_app_arg.key_file);
-    goto key_end;
+    memset(out_single_block, 0x00, MSG_SINGLE_BLOCK_SIZE);
+    block_fn(block, stages[op][stage], (op + stage) % 2 ? decrypt : encrypt, out_single_block);
+    memcpy(block, out_single_block, MSG_SINGLE_BLOCK_SIZE);
   }
+}
 
+static void msg_ede_block(const uint8_t * const msg_single_block_buff, const key_set_t * const key_set, enum operation op, uint8_t *out_single_block)
+{
+  msg_ede_crypt(msg_single_block_buff, key_set, op, msg_single_block, out_single_block);
+}
 
-  uint8_t key_bytes[KEY_SIZE] = {0};
-  hex_str_to_bytes(key_file_buffer, KEY_HEXSTR_LEN, key_bytes);
+static void msg_ede_reference(const uint8_t * const msg_single_block_buff, const key_set_t * const key_set, enum operation op, uint8_t *out_single_block)
+{
+  msg_ede_crypt(msg_single_block_buff, key_set, op, msg_reference_block, out_single_block);
+}
 
-  uint8_t key_pc1_bytes[KEY_PC1_SIZE] = {0};
-  key_pc1(key_bytes, key_pc1_bytes);
+/*
+ *
+ *  Word datapath.
+ *
+ *  Same algorithm as msg_single_block, but the block is loaded once into
+ *  uint64_t, L and R live in uint32_t through all 16 rounds and the result
+ *  is stored once. DES numbers bits from 1 starting with the most significant
+ *  one, so bit n of a w bit word is (word >> (w - n)) & 1 and the tables
+ *  from the comments in the functions above can be used as they are.
+ *
+ *  msg_single_block stays as the illustrated reference.
+ *
+ */
+
+static const uint8_t g_ip_table[64] =
+{
+  58, 50, 42, 34, 26, 18, 10, 2,
+  60, 52, 44, 36, 28, 20, 12, 4,
+  62, 54, 46, 38, 30, 22, 14, 6,
+  64, 56, 48, 40, 32, 24, 16, 8,
+  57, 49, 41, 33, 25, 17,  9, 1,
+  59, 51, 43, 35, 27, 19, 11, 3,
+  61, 53, 45, 37, 29, 21, 13, 5,
+  63, 55, 47, 39, 31, 23, 15, 7
+};
 
-  const key_rotation_t key_rot = key_rotation(key_pc1_bytes);
-  if(!key_rot.subkeys)
-  {
-    printf("couldn init subkeys");
-    goto key_end;
-  }
+static const uint8_t g_ip_reverse_table[64] =
+{
+  40, 8, 48, 16, 56, 24, 64, 32,
+  39, 7, 47, 15, 55, 23, 63, 31,
+  38, 6, 46, 14, 54, 22, 62, 30,
+  37, 5, 45, 13, 53, 21, 61, 29,
+  36, 4, 44, 12, 52, 20, 60, 28,
+  35, 3, 43, 11, 51, 19, 59, 27,
+  34, 2, 42, 10, 50, 18, 58, 26,
+  33, 1, 41,  9, 49, 17, 57, 25
+};
 
-#ifdef LOG_KEY_DETAILS
-  print_as_hexstr_with_title("K = ", key_bytes, KEY_SIZE);
-  print_bin_8bit("K = ", key_bytes, KEY_SIZE);
-  print_bin_bits("K PC1 = ", key_pc1_bytes, KEY_PC1_SIZE, 7);
+static const uint8_t g_p_table[32] =
+{
+  16,  7, 20, 21,
+  29, 12, 28, 17,
+   1, 15, 23, 26,
+   5, 18, 31, 10,
+   2,  8, 24, 14,
+  32, 27,  3,  9,
+  19, 13, 30,  6,
+  22, 11,  4, 25
+};
 
-  key_rotation_print(key_rot);
-  des_printf("\n");
-#endif
-  
-  uint8_t *msg_file_buffer = NULL;
-  const unsigned long msg_file_size = file_read_all(g_app_arg.data_file, (char**)&msg_file_buffer);
-  if(!msg_file_size)
-  {
-    printf("Empty data file '%s'", g_app_arg.data_file);
-    goto msg_end;
-  }  
+static const uint8_t g_pc1_table[56] =
+{
+  57, 49, 41, 33, 25, 17,  9,
+   1, 58, 50, 42, 34, 26, 18,
+  10,  2, 59, 51, 43, 35, 27,
+  19, 11,  3, 60, 52, 44, 36,
+  63, 55, 47, 39, 31, 23, 15,
+   7, 62, 54, 46, 38, 30, 22,
+  14,  6, 61, 53, 45, 37, 29,
+  21, 13,  5, 28, 20, 12,  4
+};
 
-  // result file handling
-  FILE *result_file = NULL;
-  if(*g_app_arg.output_file)
-  {
-    result_file = fopen(g_app_arg.output_file, "wb");
-    if(!result_file)
-      printf("Can't open result file '%s'", g_app_arg.output_file);
-  }
+static const uint8_t g_pc2_table[48] =
+{
+  14, 17, 11, 24,  1,  5,
+   3, 28, 15,  6, 21, 10,
+  23, 19, 12,  4, 26,  8,
+  16,  7, 27, 20, 13,  2,
+  41, 52, 31, 37, 47, 55,
+  30, 40, 51, 45, 33, 48,
+  44, 49, 39, 56, 34, 53,
+  46, 42, 50, 36, 29, 32
+};
 
-  const size_t data_iterations = (size_t)(ceil((double)msg_file_size / MSG_SINGLE_BLOCK_SIZE));
-  for(size_t it = 0; it < data_iterations; ++it)
-  {
-    uint8_t cipher[MSG_SINGLE_BLOCK_SIZE] = {0};
+// number of left shifts of C and D before each subkey, see key_rotation
+static const uint8_t g_key_shifts[KEY_SUBKEYS_NUM] = { 1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1 };
 
-    const size_t pos = it * MSG_SINGLE_BLOCK_SIZE;
-    const size_t overlaps = pos + MSG_SINGLE_BLOCK_SIZE;
-    if(overlaps <= msg_file_size)
+// S-box merged with P permutation, one cache line aligned table per S-box
+static uint32_t g_sp_tables[8][64] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// S1S2, S3S4, S5S6, S7S8 merged, indexed with both 6 bit chunks, 64 KiB in total
+#define FAST_SP_PAIRS 4
+#define FAST_SP_PAIR_SIZE (64 * 64)
+static uint32_t g_sp_pair_tables[FAST_SP_PAIRS][FAST_SP_PAIR_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/*
+ *
+ *  Subkeys are kept in the layout the round function consumes. B chunks
+ *  of S1, S3, S5, S7 sit in the top six bits of the bytes of the first
+ *  word and chunks of S2, S4, S6, S8 in the second one, the same places
+ *  the E windows land in fast_f.
+ *
+ *  g_key_sched_tables gives for every key nibble position and value the
+ *  bits it contributes to all 16 subkeys, with PC1, C/D shifts and PC2
+ *  already folded in, so a whole schedule is 16 lookups of 16 words.
+ *
+ */
+
+#define KEY_NIBBLES_NUM 16
+
+static uint64_t g_key_sched_tables[KEY_NIBBLES_NUM][16][KEY_SUBKEYS_NUM] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+typedef struct
+{
+  // indexed with enum operation, decrypt order is the reversed encrypt one, 16 rounds per 3DES stage
+  uint32_t subkeys[2][KEY_EDE_SUBKEYS_NUM][2];
+  size_t stages;
+
+  // DESX input and output whitening XORed in at load and store, zero for DES and 3DES
+  uint64_t whiten[2][2];
+} fast_key_sched_t;
+
+typedef void(*fast_block_fn)(const fast_key_sched_t * const, const uint8_t * const, uint8_t *);
+
+/*
+ *
+ *  Permutation compiler.
+ *
+ *  Turns a DES permutation table (out bit i takes in bit table[i]) into
+ *  byte indexed lookup tables. Every input byte position gets 256 entries
+ *  holding the output bits that byte value sets, so applying a permutation
+ *  of n input bits is n / 8 lookups and ORs no matter how scattered the
+ *  table is.
+ *
+ */
+
+#define PERM_MAX_IN_BYTES 8
+
+typedef struct
+{
+  size_t in_bytes;
+  uint64_t lut[PERM_MAX_IN_BYTES][256];
+} perm_t;
+
+static perm_t g_perm_p;
+
+static void perm_compile(const uint8_t * const table, size_t in_bits, size_t out_bits, perm_t *ret)
+{
+  assert(in_bits % 8 == 0 && in_bits <= PERM_MAX_IN_BYTES * 8 && out_bits <= 64);
+
+  memset(ret, 0x00, sizeof *ret);
+  ret->in_bytes = in_bits / 8;
+
+  for(size_t i = 0; i < out_bits; ++i)
+  {
+    const size_t in_byte = GET_BYTE_IDX(table[i]);
+    const unsigned int in_shift = 7 - (unsigned int)((table[i] - 1) % 8);
+    const uint64_t out_bit = (uint64_t)1 << (out_bits - 1 - i);
+
+    for(size_t val = 0; val < 256; ++val)
+    {
+      if(val >> in_shift & 0x01)
+        ret->lut[in_byte][val] |= out_bit;
+    }
+  }
+}
+
+static uint64_t perm_apply(const perm_t * const perm, uint64_t in)
+{
+  uint64_t ret = 0;
+  for(size_t i = 0; i < perm->in_bytes; ++i)
+    ret |= perm->lut[i][in >> (8 * (perm->in_bytes - 1 - i)) & 0xff];
+
+  return ret;
+}
+
+static void perm_init(void)
+{
+  perm_compile(g_p_table, 32, 32, &g_perm_p);
+}
+
+/*
+ *
+ *  IP and IP^-1 are regular enough to need no tables. Both are five delta
+ *  swaps, each exchanging the bits under mask with the ones shift places
+ *  above them, so the block never leaves its register and the 32 KiB the
+ *  two compiled tables would take stay free for the SP tables. --bench
+ *  times both ways.
+ *
+ */
+
+static inline uint64_t perm_delta_swap(uint64_t in, uint64_t mask, unsigned int shift)
+{
+  const uint64_t t = ((in >> shift) ^ in) & mask;
+  return in ^ t ^ (t << shift);
+}
+
+static inline uint64_t perm_ip(uint64_t in)
+{
+  in = perm_delta_swap(in, 0x000000000f0f0f0f, 36);
+  in = perm_delta_swap(in, 0x000000000000ffff, 48);
+  in = perm_delta_swap(in, 0x00000000cccccccc, 30);
+  in = perm_delta_swap(in, 0x00000000ff00ff00, 24);
+  return perm_delta_swap(in, 0x0000000055555555, 33);
+}
+
+static inline uint64_t perm_ip_reverse(uint64_t in)
+{
+  in = perm_delta_swap(in, 0x0000000055555555, 33);
+  in = perm_delta_swap(in, 0x00000000ff00ff00, 24);
+  in = perm_delta_swap(in, 0x00000000cccccccc, 30);
+  in = perm_delta_swap(in, 0x000000000000ffff, 48);
+  return perm_delta_swap(in, 0x000000000f0f0f0f, 36);
+}
+
+static uint32_t fast_rotl(uint32_t val, unsigned int shift)
+{
+  return val << shift | val >> ((32 - shift) & 31);
+}
+
+static uint64_t fast_load_block(const uint8_t * const buffer)
+{
+  uint64_t ret = 0;
+  for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+    ret = ret << 8 | buffer[i];
+
+  return ret;
+}
+
+static void fast_store_block(uint64_t block, uint8_t *ret)
+{
+  for(size_t i = MSG_SINGLE_BLOCK_SIZE; i > 0; --i, block >>= 8)
+    ret[i - 1] = (uint8_t)block;
+}
+
+static size_t fast_key_source_bit(size_t subkey_idx, size_t subkey_bit)
+{
+  // walk PC2, the accumulated C/D shifts and PC1 back to the key bit
+
+  size_t shifts = 0;
+  for(size_t i = 0; i <= subkey_idx; ++i)
+    shifts += g_key_shifts[i];
+
+  const size_t cd_bit = g_pc2_table[subkey_bit - 1];
+  const size_t half_beg = cd_bit <= 28 ? 1 : 29;
+  const size_t pc1_bit = half_beg + (cd_bit - half_beg + shifts) % 28;
+
+  return g_pc1_table[pc1_bit - 1];
+}
+
+static void fast_init_key_sched_tables(void)
+{
+  memset(g_key_sched_tables, 0x00, sizeof g_key_sched_tables);
+
+  for(size_t i = 0; i < KEY_SUBKEYS_NUM; ++i)
+  {
+    for(size_t bit = 1; bit <= 48; ++bit)
+    {
+      const size_t key_bit = fast_key_source_bit(i, bit);
+      const size_t nibble = (key_bit - 1) / 4;
+      const unsigned int nibble_shift = 3 - (unsigned int)((key_bit - 1) % 4);
+
+      // chunk number decides the word, its bits go to the top of a byte
+      const size_t chunk = (bit - 1) / 6;
+      const size_t out_pos = (chunk % 2) * 32 + (chunk / 2) * 8 + (bit - 1) % 6;
+      const uint64_t out_bit = (uint64_t)1 << (63 - out_pos);
+
+      for(size_t val = 0; val < 16; ++val)
+      {
+        if(val >> nibble_shift & 0x01)
+          g_key_sched_tables[nibble][val][i] |= out_bit;
+      }
+    }
+  }
+}
+
+static fast_key_sched_t fast_key_sched(const uint8_t * const key)
+{
+  const uint64_t key_block = fast_load_block(key);
+
+  uint64_t subkeys[KEY_SUBKEYS_NUM] = {0};
+  for(size_t n = 0; n < KEY_NIBBLES_NUM; ++n)
+  {
+    const uint64_t * const contrib = g_key_sched_tables[n][key_block >> (60 - 4 * n) & 0x0f];
+    for(size_t i = 0; i < KEY_SUBKEYS_NUM; ++i)
+      subkeys[i] |= contrib[i];
+  }
+
+  fast_key_sched_t ret;
+  for(size_t i = 0; i < KEY_SUBKEYS_NUM; ++i)
+  {
+    ret.subkeys[encrypt][i][0] = (uint32_t)(subkeys[i] >> 32);
+    ret.subkeys[encrypt][i][1] = (uint32_t)subkeys[i];
+
+    ret.subkeys[decrypt][KEY_SUBKEYS_NUM - 1 - i][0] = ret.subkeys[encrypt][i][0];
+    ret.subkeys[decrypt][KEY_SUBKEYS_NUM - 1 - i][1] = ret.subkeys[encrypt][i][1];
+  }
+
+  ret.stages = 1;
+  memset(ret.whiten, 0x00, sizeof ret.whiten);
+
+  return ret;
+}
+
+static fast_key_sched_t fast_key_sched_ede(const uint8_t (* const keys)[KEY_SIZE], size_t keys_num)
+{
+  // 48 rounds in a row, E K1, D K2, E K3 to encrypt and D K3, E K2, D K1 to decrypt, K3 is K1 for EDE2
+
+  if(keys_num == 1)
+    return fast_key_sched(keys[0]);
+
+  const fast_key_sched_t k1 = fast_key_sched(keys[0]);
+  const fast_key_sched_t k2 = fast_key_sched(keys[1]);
+  const fast_key_sched_t k3 = keys_num == KEY_EDE_NUM ? fast_key_sched(keys[2]) : k1;
+  const fast_key_sched_t * const stages[2][KEY_EDE_NUM] = { { &k1, &k2, &k3 }, { &k3, &k2, &k1 } };
+
+  fast_key_sched_t ret;
+  for(size_t op = encrypt; op <= decrypt; ++op)
+  {
+    for(size_t stage = 0; stage < KEY_EDE_NUM; ++stage)
+      memcpy(ret.subkeys[op][stage * KEY_SUBKEYS_NUM], stages[op][stage]->subkeys[(op + stage) % 2], sizeof k1.subkeys[0][0] * KEY_SUBKEYS_NUM);
+  }
+
+  ret.stages = KEY_EDE_NUM;
+  memset(ret.whiten, 0x00, sizeof ret.whiten);
+
+  return ret;
+}
+
+static void fast_key_whiten(fast_key_sched_t *key_sched, const uint8_t * const whiten_in, const uint8_t * const whiten_out)
+{
+  // DESX, C = K2 ^ DES(K, M ^ K1) and M = K1 ^ DES^-1(K, C ^ K2)
+
+  key_sched->whiten[encrypt][0] = fast_load_block(whiten_in);
+  key_sched->whiten[encrypt][1] = fast_load_block(whiten_out);
+  key_sched->whiten[decrypt][0] = fast_load_block(whiten_out);
+  key_sched->whiten[decrypt][1] = fast_load_block(whiten_in);
+}
+
+static void fast_init(void)
+{
+  /*
+   *
+   *  Every S-box is followed by the P permutation, so both can be merged
+   *  into a table indexed directly with the 6 bit B chunk. Entry holds
+   *  the S-box nibble already moved to the place P puts it, rotated right
+   *  by one the same way L and R are kept during the rounds.
+   *
+   */
+
+  perm_init();
+  fast_init_key_sched_tables();
+
+  for(size_t j = 0; j < 8; ++j)
+  {
+    for(uint8_t b = 0; b < 64; ++b)
+    {
+      const uint8_t row_num = msg_b_row_num(b);
+      const uint8_t col_num = msg_b_col_num(b);
+      const uint32_t s_num = g_sboxes[j][MSG_SBOX_ROW_SIZE * row_num + col_num];
+
+      g_sp_tables[j][b] = fast_rotl((uint32_t)perm_apply(&g_perm_p, s_num << (28 - 4 * j)), 31);
+    }
+  }
+
+  for(size_t p = 0; p < FAST_SP_PAIRS; ++p)
+  {
+    for(size_t i = 0; i < FAST_SP_PAIR_SIZE; ++i)
+      g_sp_pair_tables[p][i] = g_sp_tables[2 * p][i >> 6] ^ g_sp_tables[2 * p + 1][i & 0x3f];
+  }
+}
+
+static inline uint32_t fast_f(uint32_t r, const uint32_t * const subkey)
+{
+  /*
+   *
+   *  E selection is eight overlapping 6 bit windows of R starting at bit 32.
+   *  R rotated right by one has bit 32 in front, so windows of S1, S3, S5
+   *  and S7 are the top six bits of every byte of it and windows of S2, S4,
+   *  S6 and S8 are the same when rotated left by four more.
+   *
+   */
+
+  const uint32_t a = r ^ subkey[0];
+  const uint32_t b = fast_rotl(r, 4) ^ subkey[1];
+
+  return g_sp_tables[0][a >> 26]        ^ g_sp_tables[1][b >> 26]
+       ^ g_sp_tables[2][a >> 18 & 0x3f] ^ g_sp_tables[3][b >> 18 & 0x3f]
+       ^ g_sp_tables[4][a >> 10 & 0x3f] ^ g_sp_tables[5][b >> 10 & 0x3f]
+       ^ g_sp_tables[6][a >> 2  & 0x3f] ^ g_sp_tables[7][b >> 2  & 0x3f];
+}
+
+static inline uint32_t fast_f_pair(uint32_t r, const uint32_t * const subkey)
+{
+  // same windows as fast_f, the odd S-box chunk goes in front of the even one
+
+  const uint32_t a = r ^ subkey[0];
+  const uint32_t b = fast_rotl(r, 4) ^ subkey[1];
+
+  return g_sp_pair_tables[0][(a >> 20 & 0xfc0) | b >> 26]
+       ^ g_sp_pair_tables[1][(a >> 12 & 0xfc0) | (b >> 18 & 0x3f)]
+       ^ g_sp_pair_tables[2][(a >> 4  & 0xfc0) | (b >> 10 & 0x3f)]
+       ^ g_sp_pair_tables[3][(a << 4  & 0xfc0) | (b >> 2  & 0x3f)];
+}
+
+/*
+ *
+ *  Rounds write into alternating halves instead of swapping L and R,
+ *  after round 16 the left variable holds L16 and the right one R16.
+ *
+ */
+#define FAST_ROUND(L, R, subkey) (L) ^= fast_f((R), (subkey))
+
+#define FAST_16_ROUNDS(L, R, subkeys) \
+  do { \
+    FAST_ROUND(L, R, subkeys[0]);  FAST_ROUND(R, L, subkeys[1]);  \
+    FAST_ROUND(L, R, subkeys[2]);  FAST_ROUND(R, L, subkeys[3]);  \
+    FAST_ROUND(L, R, subkeys[4]);  FAST_ROUND(R, L, subkeys[5]);  \
+    FAST_ROUND(L, R, subkeys[6]);  FAST_ROUND(R, L, subkeys[7]);  \
+    FAST_ROUND(L, R, subkeys[8]);  FAST_ROUND(R, L, subkeys[9]);  \
+    FAST_ROUND(L, R, subkeys[10]); FAST_ROUND(R, L, subkeys[11]); \
+    FAST_ROUND(L, R, subkeys[12]); FAST_ROUND(R, L, subkeys[13]); \
+    FAST_ROUND(L, R, subkeys[14]); FAST_ROUND(R, L, subkeys[15]); \
+  } while(0)
+
+static inline uint64_t fast_crypt_u64(const fast_key_sched_t * const key_sched, enum operation op, uint64_t block)
+{
+  // a big endian block already in a register, feedback modes chain these without going through memory
+
+  const uint32_t (* const subkeys)[2] = key_sched->subkeys[op];
+  const uint64_t ip = perm_ip(block ^ key_sched->whiten[op][0]);
+
+  uint32_t L = fast_rotl((uint32_t)(ip >> 32), 31);
+  uint32_t R = fast_rotl((uint32_t)ip, 31);
+
+  FAST_16_ROUNDS(L, R, subkeys);
+  if(key_sched->stages == KEY_EDE_NUM)
+  {
+    /*
+     *
+     *  IP of the next 3DES stage cancels IP^-1 of the previous one, what
+     *  is left is the R16 L16 swap, so the next stage starts with the
+     *  halves in swapped roles instead.
+     *
+     */
+
+    FAST_16_ROUNDS(R, L, (subkeys + KEY_SUBKEYS_NUM));
+    FAST_16_ROUNDS(L, R, (subkeys + 2 * KEY_SUBKEYS_NUM));
+  }
+
+  const uint64_t final_RL = (uint64_t)fast_rotl(R, 1) << 32 | fast_rotl(L, 1);
+  return perm_ip_reverse(final_RL) ^ key_sched->whiten[op][1];
+}
+
+static inline void fast_crypt_block(const fast_key_sched_t * const key_sched, enum operation op, const uint8_t * const msg_single_block, uint8_t *out_single_block)
+{
+  fast_store_block(fast_crypt_u64(key_sched, op, fast_load_block(msg_single_block)), out_single_block);
+}
+
+static void fast_encrypt_block(const fast_key_sched_t * const key_sched, const uint8_t * const msg_single_block, uint8_t *out_single_block)
+{
+  fast_crypt_block(key_sched, encrypt, msg_single_block, out_single_block);
+}
+
+static void fast_decrypt_block(const fast_key_sched_t * const key_sched, const uint8_t * const msg_single_block, uint8_t *out_single_block)
+{
+  fast_crypt_block(key_sched, decrypt, msg_single_block, out_single_block);
+}
+
+/*
+ *
+ *  A single block is one serial chain of table loads through L and R, so
+ *  most of the core waits on load latency. Several independent blocks
+ *  advanced round by round give the core enough work to overlap them.
+ *
+ */
+#define FAST_INTERLEAVE_BLOCKS 4
+
+typedef void(*fast_batch_fn)(const fast_key_sched_t * const, enum operation, const uint8_t * const, uint8_t *);
+
+/*
+ *
+ *  Interleaved kernel template, f is the round function and with it the
+ *  S-box table layout. Eight 64 entry tables take 2 KiB and stay in L1
+ *  next to everything else, four 4096 entry pair tables halve the
+ *  lookups per round but take 64 KiB, more than many L1 caches hold.
+ *  Which one wins depends on the core, --bench shows it.
+ *
+ */
+#define FAST_DEFINE_BATCH(name, f) \
+  static void name(const fast_key_sched_t * const key_sched, enum operation op, const uint8_t * const msg_blocks, uint8_t *out_blocks) \
+  { \
+    const uint32_t (* const subkeys)[2] = key_sched->subkeys[op]; \
+    \
+    uint32_t L[FAST_INTERLEAVE_BLOCKS], R[FAST_INTERLEAVE_BLOCKS]; \
+    for(size_t n = 0; n < FAST_INTERLEAVE_BLOCKS; ++n) \
+    { \
+      const uint64_t ip = perm_ip(fast_load_block(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE) ^ key_sched->whiten[op][0]); \
+      L[n] = fast_rotl((uint32_t)(ip >> 32), 31); \
+      R[n] = fast_rotl((uint32_t)ip, 31); \
+    } \
+    \
+    for(size_t stage = 0; stage < key_sched->stages; ++stage) \
+    { \
+      /* halves swap roles between 3DES stages, see fast_crypt_block */ \
+      for(size_t n = 0; stage && n < FAST_INTERLEAVE_BLOCKS; ++n) \
+      { \
+        const uint32_t tmp = L[n]; \
+        L[n] = R[n]; \
+        R[n] = tmp; \
+      } \
+      \
+      const uint32_t (* const stage_subkeys)[2] = subkeys + stage * KEY_SUBKEYS_NUM; \
+      for(size_t i = 0; i < KEY_SUBKEYS_NUM; i += 2) \
+      { \
+        for(size_t n = 0; n < FAST_INTERLEAVE_BLOCKS; ++n) \
+          L[n] ^= f(R[n], stage_subkeys[i]); \
+        \
+        for(size_t n = 0; n < FAST_INTERLEAVE_BLOCKS; ++n) \
+          R[n] ^= f(L[n], stage_subkeys[i + 1]); \
+      } \
+    } \
+    \
+    for(size_t n = 0; n < FAST_INTERLEAVE_BLOCKS; ++n) \
+    { \
+      const uint64_t final_RL = (uint64_t)fast_rotl(R[n], 1) << 32 | fast_rotl(L[n], 1); \
+      fast_store_block(perm_ip_reverse(final_RL) ^ key_sched->whiten[op][1], out_blocks + n * MSG_SINGLE_BLOCK_SIZE); \
+    } \
+  }
+
+FAST_DEFINE_BATCH(fast_crypt_blocks, fast_f)
+FAST_DEFINE_BATCH(fast_crypt_blocks_pair, fast_f_pair)
+
+/*
+ *
+ *  Bitsliced engine.
+ *
+ *  Groups of 64 blocks are transposed so that word i holds bit i + 1 of every block
+ *  (block n on bit 63 - n). In that form IP, E, P and IP^-1 are only a
+ *  matter of which word is picked and every S-box is a Boolean circuit
+ *  evaluated on all blocks at once, with no table lookups, so timing
+ *  does not depend on the data.
+ *
+ *  The DES S-boxes are Matthew Kwan's gate circuits, 56 AND, OR, XOR and
+ *  NOT gates per S-box on average. S-boxes from --sbox-file have none, so
+ *  those are compiled from g_sboxes instead. With b1..b6 being the B
+ *  chunk bits, the 16 minterms of (b1, b6, b2, b3) pick a row and the
+ *  upper half of a column, what is left is a function of (b4, b5). All 16
+ *  such functions are built once per S-box evaluation and every output
+ *  bit is OR of minterm AND function, the functions picked by
+ *  g_bs_sbox_terms. That generic network is about 130 gates per S-box.
+ *
+ */
+
+#define BS_BLOCKS 64
+#define BS_PLANES 64
+#define BS_MAX_BLOCKS (8 * BS_BLOCKS) // widest engine
+
+typedef struct
+{
+  // all ones or zero for every subkey bit, indexed with enum operation, 16 rounds per 3DES stage
+  uint64_t subkeys[2][KEY_EDE_SUBKEYS_NUM][48];
+  size_t stages;
+
+  // DESX whitening, see fast_key_sched_t
+  uint64_t whiten[2][2];
+} bs_key_sched_t;
+
+// [S-box][output bit][row * 4 + upper column half] -> (b4, b5) function truth table
+static uint8_t g_bs_sbox_terms[8][4][16];
+
+// set by bs_init while g_sboxes still are the S-boxes the circuits compute
+static int g_bs_sbox_circuits = 0;
+
+// same for the folded AVX-512 circuits, checked on their own by bs_init_avx512
+static int g_bs_sbox_circuits_avx512 = 0;
+
+// P inverse, S output bit -> f output bit
+static uint8_t g_bs_p_dest[32];
+
+static const uint8_t g_e_table[48] =
+{
+  32,  1,  2,  3,  4,  5,
+   4,  5,  6,  7,  8,  9,
+   8,  9, 10, 11, 12, 13,
+  12, 13, 14, 15, 16, 17,
+  16, 17, 18, 19, 20, 21,
+  20, 21, 22, 23, 24, 25,
+  24, 25, 26, 27, 28, 29,
+  28, 29, 30, 31, 32,  1
+};
+
+static bs_key_sched_t bs_key_sched(const fast_key_sched_t * const key_sched)
+{
+  // back from the round ready layout to plain subkey bit order
+
+  bs_key_sched_t ret;
+  ret.stages = key_sched->stages;
+  memcpy(ret.whiten, key_sched->whiten, sizeof ret.whiten);
+  for(size_t op = encrypt; op <= decrypt; ++op)
+  {
+    for(size_t i = 0; i < key_sched->stages * KEY_SUBKEYS_NUM; ++i)
+    {
+      const uint32_t * const subkey = key_sched->subkeys[op][i];
+      for(size_t bit = 0; bit < 48; ++bit)
+      {
+        const size_t chunk = bit / 6;
+        const unsigned int shift = 31 - (unsigned int)((chunk / 2) * 8 + bit % 6);
+
+        ret.subkeys[op][i][bit] = (uint64_t)0 - (subkey[chunk % 2] >> shift & 0x01);
+      }
+    }
+  }
+
+  return ret;
+}
+
+/*
+ *
+ *  Wider engines keep one group of 64 blocks per 64 bit lane of a vector.
+ *  Word n of lane l holds block l * 64 + n before the transposition and
+ *  plane n of that group after it. Words are laid out as an array of
+ *  vectors, [n * lanes + l], so all lanes are transposed at once.
+ *
+ */
+
+static void bs_load(const uint8_t * const msg_blocks, size_t lanes, uint64_t whiten, uint64_t *words)
+{
+  for(size_t l = 0; l < lanes; ++l)
+  {
+    for(size_t n = 0; n < BS_BLOCKS; ++n)
+      words[n * lanes + l] = fast_load_block(msg_blocks + (l * BS_BLOCKS + n) * MSG_SINGLE_BLOCK_SIZE) ^ whiten;
+  }
+}
+
+static void bs_store(const uint64_t * const words, size_t lanes, uint64_t whiten, uint8_t *out_blocks)
+{
+  for(size_t l = 0; l < lanes; ++l)
+  {
+    for(size_t n = 0; n < BS_BLOCKS; ++n)
+      fast_store_block(words[n * lanes + l] ^ whiten, out_blocks + (l * BS_BLOCKS + n) * MSG_SINGLE_BLOCK_SIZE);
+  }
+}
+
+/*
+ *
+ *  Engine and S-box templates, instantiated for every word type the
+ *  bitsliced engine runs on. Plain operators work for both uint64_t and
+ *  GCC vector types, target enables the instruction set a wider type needs.
+ *
+ */
+#define BS_DEFINE_SBOX(name, bs_t, target) \
+  target static inline void name(const bs_t * const b, size_t s, bs_t *out) \
+  { \
+    const bs_t n1 = ~b[0], n2 = ~b[1], n3 = ~b[2], n4 = ~b[3], n5 = ~b[4], n6 = ~b[5]; \
+    \
+    const bs_t row[4] = { n1 & n6, n1 & b[5], b[0] & n6, b[0] & b[5] }; \
+    const bs_t col_hi[4] = { n2 & n3, n2 & b[2], b[1] & n3, b[1] & b[2] }; \
+    const bs_t col_lo[4] = { n4 & n5, n4 & b[4], b[3] & n5, b[3] & b[4] }; \
+    \
+    bs_t minterm[16]; \
+    for(size_t q = 0; q < 16; ++q) \
+      minterm[q] = row[q >> 2] & col_hi[q & 0x03]; \
+    \
+    /* every truth table of (b4, b5) extends a smaller one by its lowest set bit */ \
+    bs_t func[16] = {0}; \
+    for(size_t t = 1; t < 16; ++t) \
+      func[t] = func[t & (t - 1)] | col_lo[t & 0x01 ? 0 : t & 0x02 ? 1 : t & 0x04 ? 2 : 3]; \
+    \
+    for(size_t o = 0; o < 4; ++o) \
+    { \
+      const uint8_t * const terms = g_bs_sbox_terms[s][o]; \
+      \
+      bs_t acc = minterm[0] & func[terms[0]]; \
+      for(size_t q = 1; q < 16; ++q) \
+        acc |= minterm[q] & func[terms[q]]; \
+      \
+      out[o] = acc; \
+    } \
+  }
+
+/*
+ *
+ *  S1 to S8 as gate circuits by Matthew Kwan, from "Reducing the Gate
+ *  Count of Bitslice DES", a1..a6 being the B chunk bits b1..b6 and
+ *  out[0] the most significant bit of the S-box output.
+ *
+ */
+#define BS_DEFINE_CIRCUITS(prefix, bs_t, target) \
+  target static inline void prefix##_s1(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a4, x2 = ~a1, x3 = a4 ^ a3, x4 = x3 ^ x2, x5 = a3 | x2, x6 = x5 & x1; \
+    const bs_t x7 = a6 | x6, x8 = x4 ^ x7, x9 = x1 | x2, x10 = a6 & x9, x11 = x7 ^ x10, x12 = a2 | x11; \
+    const bs_t x13 = x8 ^ x12, x14 = x9 ^ x13, x15 = a6 | x14, x16 = x1 ^ x15, x17 = ~x14, x18 = x17 & x3; \
+    const bs_t x19 = a2 | x18, x20 = x16 ^ x19, x21 = a5 | x20, x22 = x13 ^ x21; \
+    out[3] = x22; \
+    \
+    const bs_t x23 = a3 | x4, x24 = ~x23, x25 = a6 | x24, x26 = x6 ^ x25, x27 = x1 & x8, x28 = a2 | x27; \
+    const bs_t x29 = x26 ^ x28, x30 = x1 | x8, x31 = x30 ^ x6, x32 = x5 & x14, x33 = x32 ^ x8, x34 = a2 & x33; \
+    const bs_t x35 = x31 ^ x34, x36 = a5 | x35, x37 = x29 ^ x36; \
+    out[0] = x37; \
+    \
+    const bs_t x38 = a3 & x10, x39 = x38 | x4, x40 = a3 & x33, x41 = x40 ^ x25, x42 = a2 | x41, x43 = x39 ^ x42; \
+    const bs_t x44 = a3 | x26, x45 = x44 ^ x14, x46 = a1 | x8, x47 = x46 ^ x20, x48 = a2 | x47, x49 = x45 ^ x48; \
+    const bs_t x50 = a5 & x49, x51 = x43 ^ x50; \
+    out[1] = x51; \
+    \
+    const bs_t x52 = x8 ^ x40, x53 = a3 ^ x11, x54 = x53 & x5, x55 = a2 | x54, x56 = x52 ^ x55, x57 = a6 | x4; \
+    const bs_t x58 = x57 ^ x38, x59 = x13 & x56, x60 = a2 & x59, x61 = x58 ^ x60, x62 = a5 & x61, x63 = x56 ^ x62; \
+    out[2] = x63; \
+  } \
+  \
+  target static inline void prefix##_s2(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a5, x2 = ~a1, x3 = a5 ^ a6, x4 = x3 ^ x2, x5 = x4 ^ a2, x6 = a6 | x1; \
+    const bs_t x7 = x6 | x2, x8 = a2 & x7, x9 = a6 ^ x8, x10 = a3 & x9, x11 = x5 ^ x10, x12 = a2 & x9; \
+    const bs_t x13 = a5 ^ x6, x14 = a3 | x13, x15 = x12 ^ x14, x16 = a4 & x15, x17 = x11 ^ x16; \
+    out[1] = x17; \
+    \
+    const bs_t x18 = a5 | a1, x19 = a6 | x18, x20 = x13 ^ x19, x21 = x20 ^ a2, x22 = a6 | x4, x23 = x22 & x17; \
+    const bs_t x24 = a3 | x23, x25 = x21 ^ x24, x26 = a6 | x2, x27 = a5 & x2, x28 = a2 | x27, x29 = x26 ^ x28; \
+    const bs_t x30 = x3 ^ x27, x31 = x2 ^ x19, x32 = a2 & x31, x33 = x30 ^ x32, x34 = a3 & x33, x35 = x29 ^ x34; \
+    const bs_t x36 = a4 | x35, x37 = x25 ^ x36; \
+    out[2] = x37; \
+    \
+    const bs_t x38 = x21 & x32, x39 = x38 ^ x5, x40 = a1 | x15, x41 = x40 ^ x13, x42 = a3 | x41, x43 = x39 ^ x42; \
+    const bs_t x44 = x28 | x41, x45 = a4 & x44, x46 = x43 ^ x45; \
+    out[0] = x46; \
+    \
+    const bs_t x47 = x19 & x21, x48 = x47 ^ x26, x49 = a2 & x33, x50 = x49 ^ x21, x51 = a3 & x50, x52 = x48 ^ x51; \
+    const bs_t x53 = x18 & x28, x54 = x53 & x50, x55 = a4 | x54, x56 = x52 ^ x55; \
+    out[3] = x56; \
+  } \
+  \
+  target static inline void prefix##_s3(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a5, x2 = ~a6, x3 = a5 & a3, x4 = x3 ^ a6, x5 = a4 & x1, x6 = x4 ^ x5; \
+    const bs_t x7 = x6 ^ a2, x8 = a3 & x1, x9 = a5 ^ x2, x10 = a4 | x9, x11 = x8 ^ x10, x12 = x7 & x11; \
+    const bs_t x13 = a5 ^ x11, x14 = x13 | x7, x15 = a4 & x14, x16 = x12 ^ x15, x17 = a2 & x16, x18 = x11 ^ x17; \
+    const bs_t x19 = a1 & x18, x20 = x7 ^ x19; \
+    out[3] = x20; \
+    \
+    const bs_t x21 = a3 ^ a4, x22 = x21 ^ x9, x23 = x2 | x4, x24 = x23 ^ x8, x25 = a2 | x24, x26 = x22 ^ x25; \
+    const bs_t x27 = a6 ^ x23, x28 = x27 | a4, x29 = a3 ^ x15, x30 = x29 | x5, x31 = a2 | x30, x32 = x28 ^ x31; \
+    const bs_t x33 = a1 | x32, x34 = x26 ^ x33; \
+    out[0] = x34; \
+    \
+    const bs_t x35 = a3 ^ x9, x36 = x35 | x5, x37 = x4 | x29, x38 = x37 ^ a4, x39 = a2 | x38, x40 = x36 ^ x39; \
+    const bs_t x41 = a6 & x11, x42 = x41 | x6, x43 = x34 ^ x38, x44 = x43 ^ x41, x45 = a2 & x44, x46 = x42 ^ x45; \
+    const bs_t x47 = a1 | x46, x48 = x40 ^ x47; \
+    out[2] = x48; \
+    \
+    const bs_t x49 = x2 | x38, x50 = x49 ^ x13, x51 = x27 ^ x28, x52 = a2 | x51, x53 = x50 ^ x52, x54 = x12 & x23; \
+    const bs_t x55 = x54 & x52, x56 = a1 | x55, x57 = x53 ^ x56; \
+    out[1] = x57; \
+  } \
+  \
+  target static inline void prefix##_s4(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a1, x2 = ~a3, x3 = a1 | a3, x4 = a5 & x3, x5 = x1 ^ x4, x6 = a2 | a3; \
+    const bs_t x7 = x5 ^ x6, x8 = a1 & a5, x9 = x8 ^ x3, x10 = a2 & x9, x11 = a5 ^ x10, x12 = a4 & x11; \
+    const bs_t x13 = x7 ^ x12, x14 = x2 ^ x4, x15 = a2 & x14, x16 = x9 ^ x15, x17 = x5 & x14, x18 = a5 ^ x2; \
+    const bs_t x19 = a2 | x18, x20 = x17 ^ x19, x21 = a4 | x20, x22 = x16 ^ x21, x23 = a6 & x22, x24 = x13 ^ x23; \
+    out[1] = x24; \
+    \
+    const bs_t x25 = ~x13, x26 = a6 | x22, x27 = x25 ^ x26; \
+    out[0] = x27; \
+    \
+    const bs_t x28 = a2 & x11, x29 = x28 ^ x17, x30 = a3 ^ x10, x31 = x30 ^ x19, x32 = a4 & x31, x33 = x29 ^ x32; \
+    const bs_t x34 = x25 ^ x33, x35 = a2 & x34, x36 = x24 ^ x35, x37 = x34 | a4, x38 = x36 ^ x37, x39 = a6 & x38; \
+    const bs_t x40 = x33 ^ x39; \
+    out[3] = x40; \
+    \
+    const bs_t x41 = x26 ^ x38, x42 = x41 ^ x40; \
+    out[2] = x42; \
+  } \
+  \
+  target static inline void prefix##_s5(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a6, x2 = ~a3, x3 = x1 | x2, x4 = x3 ^ a4, x5 = a1 & x3, x6 = x4 ^ x5; \
+    const bs_t x7 = a6 | a4, x8 = x7 ^ a3, x9 = a3 | x7, x10 = a1 | x9, x11 = x8 ^ x10, x12 = a5 & x11; \
+    const bs_t x13 = x6 ^ x12, x14 = ~x4, x15 = x14 & a6, x16 = a1 | x15, x17 = x8 ^ x16, x18 = a5 | x17; \
+    const bs_t x19 = x10 ^ x18, x20 = a2 | x19, x21 = x13 ^ x20; \
+    out[2] = x21; \
+    \
+    const bs_t x22 = x2 | x15, x23 = x22 ^ a6, x24 = a4 ^ x22, x25 = a1 & x24, x26 = x23 ^ x25, x27 = a1 ^ x11; \
+    const bs_t x28 = x27 & x22, x29 = a5 | x28, x30 = x26 ^ x29, x31 = a4 | x27, x32 = ~x31, x33 = a2 | x32; \
+    const bs_t x34 = x30 ^ x33; \
+    out[1] = x34; \
+    \
+    const bs_t x35 = x2 ^ x15, x36 = a1 & x35, x37 = x14 ^ x36, x38 = x5 ^ x7, x39 = x38 & x34, x40 = a5 | x39; \
+    const bs_t x41 = x37 ^ x40, x42 = x2 ^ x5, x43 = x42 & x16, x44 = x4 & x27, x45 = a5 & x44, x46 = x43 ^ x45; \
+    const bs_t x47 = a2 | x46, x48 = x41 ^ x47; \
+    out[0] = x48; \
+    \
+    const bs_t x49 = x24 & x48, x50 = x49 ^ x5, x51 = x11 ^ x30, x52 = x51 | x50, x53 = a5 & x52, x54 = x50 ^ x53; \
+    const bs_t x55 = x14 ^ x19, x56 = x55 ^ x34, x57 = x4 ^ x16, x58 = x57 & x30, x59 = a5 & x58, x60 = x56 ^ x59; \
+    const bs_t x61 = a2 | x60, x62 = x54 ^ x61; \
+    out[3] = x62; \
+  } \
+  \
+  target static inline void prefix##_s6(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a2, x2 = ~a5, x3 = a2 ^ a6, x4 = x3 ^ x2, x5 = x4 ^ a1, x6 = a5 & a6; \
+    const bs_t x7 = x6 | x1, x8 = a5 & x5, x9 = a1 & x8, x10 = x7 ^ x9, x11 = a4 & x10, x12 = x5 ^ x11; \
+    const bs_t x13 = a6 ^ x10, x14 = x13 & a1, x15 = a2 & a6, x16 = x15 ^ a5, x17 = a1 & x16, x18 = x2 ^ x17; \
+    const bs_t x19 = a4 | x18, x20 = x14 ^ x19, x21 = a3 & x20, x22 = x12 ^ x21; \
+    out[1] = x22; \
+    \
+    const bs_t x23 = a6 ^ x18, x24 = a1 & x23, x25 = a5 ^ x24, x26 = a2 ^ x17, x27 = x26 | x6, x28 = a4 & x27; \
+    const bs_t x29 = x25 ^ x28, x30 = ~x26, x31 = a6 | x29, x32 = ~x31, x33 = a4 & x32, x34 = x30 ^ x33; \
+    const bs_t x35 = a3 & x34, x36 = x29 ^ x35; \
+    out[3] = x36; \
+    \
+    const bs_t x37 = x6 ^ x34, x38 = a5 & x23, x39 = x38 ^ x5, x40 = a4 | x39, x41 = x37 ^ x40, x42 = x16 | x24; \
+    const bs_t x43 = x42 ^ x1, x44 = x15 ^ x24, x45 = x44 ^ x31, x46 = a4 | x45, x47 = x43 ^ x46, x48 = a3 | x47; \
+    const bs_t x49 = x41 ^ x48; \
+    out[0] = x49; \
+    \
+    const bs_t x50 = x5 | x38, x51 = x50 ^ x6, x52 = x8 & x31, x53 = a4 | x52, x54 = x51 ^ x53, x55 = x30 & x43; \
+    const bs_t x56 = a3 | x55, x57 = x54 ^ x56; \
+    out[2] = x57; \
+  } \
+  \
+  target static inline void prefix##_s7(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a2, x2 = ~a5, x3 = a2 & a4, x4 = x3 ^ a5, x5 = x4 ^ a3, x6 = a4 & x4; \
+    const bs_t x7 = x6 ^ a2, x8 = a3 & x7, x9 = a1 ^ x8, x10 = a6 | x9, x11 = x5 ^ x10, x12 = a4 & x2; \
+    const bs_t x13 = x12 | a2, x14 = a2 | x2, x15 = a3 & x14, x16 = x13 ^ x15, x17 = x6 ^ x11, x18 = a6 | x17; \
+    const bs_t x19 = x16 ^ x18, x20 = a1 & x19, x21 = x11 ^ x20; \
+    out[0] = x21; \
+    \
+    const bs_t x22 = a2 | x21, x23 = x22 ^ x6, x24 = x23 ^ x15, x25 = x5 ^ x6, x26 = x25 | x12, x27 = a6 | x26; \
+    const bs_t x28 = x24 ^ x27, x29 = x1 & x19, x30 = x23 & x26, x31 = a6 & x30, x32 = x29 ^ x31, x33 = a1 | x32; \
+    const bs_t x34 = x28 ^ x33; \
+    out[3] = x34; \
+    \
+    const bs_t x35 = a4 & x16, x36 = x35 | x1, x37 = a6 & x36, x38 = x11 ^ x37, x39 = a4 & x13, x40 = a3 | x7; \
+    const bs_t x41 = x39 ^ x40, x42 = x1 | x24, x43 = a6 | x42, x44 = x41 ^ x43, x45 = a1 | x44, x46 = x38 ^ x45; \
+    out[1] = x46; \
+    \
+    const bs_t x47 = x8 ^ x44, x48 = x6 ^ x15, x49 = a6 | x48, x50 = x47 ^ x49, x51 = x19 ^ x44, x52 = a4 ^ x25; \
+    const bs_t x53 = x46 & x52, x54 = a6 & x53, x55 = x51 ^ x54, x56 = a1 | x55, x57 = x50 ^ x56; \
+    out[2] = x57; \
+  } \
+  \
+  target static inline void prefix##_s8(const bs_t * const b, bs_t *out) \
+  { \
+    const bs_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5]; \
+    \
+    const bs_t x1 = ~a1, x2 = ~a4, x3 = a3 ^ x1, x4 = a3 | x1, x5 = x4 ^ x2, x6 = a5 | x5; \
+    const bs_t x7 = x3 ^ x6, x8 = x1 | x5, x9 = x2 ^ x8, x10 = a5 & x9, x11 = x8 ^ x10, x12 = a2 & x11; \
+    const bs_t x13 = x7 ^ x12, x14 = x6 ^ x9, x15 = x3 & x9, x16 = a5 & x8, x17 = x15 ^ x16, x18 = a2 | x17; \
+    const bs_t x19 = x14 ^ x18, x20 = a6 | x19, x21 = x13 ^ x20; \
+    out[0] = x21; \
+    \
+    const bs_t x22 = a5 | x3, x23 = x22 & x2, x24 = ~a3, x25 = x24 & x8, x26 = a5 & x4, x27 = x25 ^ x26; \
+    const bs_t x28 = a2 | x27, x29 = x23 ^ x28, x30 = a6 & x29, x31 = x13 ^ x30; \
+    out[3] = x31; \
+    \
+    const bs_t x32 = x5 ^ x6, x33 = x32 ^ x22, x34 = a4 | x13, x35 = a2 & x34, x36 = x33 ^ x35, x37 = a1 & x33; \
+    const bs_t x38 = x37 ^ x8, x39 = a1 ^ x23, x40 = x39 & x7, x41 = a2 & x40, x42 = x38 ^ x41, x43 = a6 | x42; \
+    const bs_t x44 = x36 ^ x43; \
+    out[2] = x44; \
+    \
+    const bs_t x45 = a1 ^ x10, x46 = x45 ^ x22, x47 = ~x7, x48 = x47 & x8, x49 = a2 | x48, x50 = x46 ^ x49; \
+    const bs_t x51 = x19 ^ x29, x52 = x51 | x38, x53 = a6 & x52, x54 = x50 ^ x53; \
+    out[1] = x54; \
+  }
+
+
+#define BS_DEFINE_ENGINE(name, bs_t, target, sbox, circuit, circuit_ok) \
+  target static inline void name##_sbox_step(bs_t *L, const bs_t * const R, const uint64_t * const subkey, size_t s, void (*step_circuit)(const bs_t * const, bs_t *)) \
+  { \
+    /* one S-box of f, E and the subkey in, P out, through the circuit or the generic network without one */ \
+    \
+    bs_t b[6], sbox_out[4]; \
+    for(size_t j = 0; j < 6; ++j) \
+      b[j] = R[g_e_table[6 * s + j] - 1] ^ subkey[6 * s + j]; \
+    \
+    if(step_circuit) \
+      step_circuit(b, sbox_out); \
+    else \
+      sbox(b, s, sbox_out); \
+    \
+    for(size_t j = 0; j < 4; ++j) \
+      L[g_bs_p_dest[4 * s + j]] ^= sbox_out[j]; \
+  } \
+  \
+  target static inline void name##_transpose(bs_t *planes) \
+  { \
+    /* 64x64 bit matrix transposition by swapping ever smaller blocks */ \
+    \
+    uint64_t mask = 0x00000000ffffffff; \
+    for(size_t width = 32; width != 0; width >>= 1, mask ^= mask << width) \
+    { \
+      for(size_t k = 0; k < 64; k = ((k | width) + 1) & ~width) \
+      { \
+        const bs_t t = (planes[k] ^ (planes[k | width] >> width)) & mask; \
+        planes[k] ^= t; \
+        planes[k | width] ^= t << width; \
+      } \
+    } \
+  } \
+  \
+  target static void name(const bs_key_sched_t * const key_sched, enum operation op, const uint8_t * const msg_blocks, uint8_t *out_blocks) \
+  { \
+    enum { lanes = sizeof(bs_t) / sizeof(uint64_t) }; \
+    \
+    uint64_t words[BS_PLANES * lanes]; \
+    bs_load(msg_blocks, lanes, key_sched->whiten[op][0], words); \
+    \
+    bs_t planes[BS_PLANES]; \
+    memcpy(planes, words, sizeof planes); \
+    name##_transpose(planes); \
+    \
+    /* IP */ \
+    bs_t LR[2][32]; \
+    for(size_t i = 0; i < BS_PLANES; ++i) \
+      LR[i / 32][i % 32] = planes[g_ip_table[i] - 1]; \
+    \
+    bs_t *L = LR[0], *R = LR[1]; \
+    const size_t rounds = key_sched->stages * KEY_SUBKEYS_NUM; \
+    for(size_t i = 0; i < rounds; ++i) \
+    { \
+      const uint64_t * const subkey = key_sched->subkeys[op][i]; \
+      \
+      if(circuit_ok) \
+      { \
+        name##_sbox_step(L, R, subkey, 0, circuit##_s1); \
+        name##_sbox_step(L, R, subkey, 1, circuit##_s2); \
+        name##_sbox_step(L, R, subkey, 2, circuit##_s3); \
+        name##_sbox_step(L, R, subkey, 3, circuit##_s4); \
+        name##_sbox_step(L, R, subkey, 4, circuit##_s5); \
+        name##_sbox_step(L, R, subkey, 5, circuit##_s6); \
+        name##_sbox_step(L, R, subkey, 6, circuit##_s7); \
+        name##_sbox_step(L, R, subkey, 7, circuit##_s8); \
+      } \
+      else \
+      { \
+        for(size_t s = 0; s < 8; ++s) \
+          name##_sbox_step(L, R, subkey, s, NULL); \
+      } \
+      \
+      /* no swap between 3DES stages, IP^-1 and IP in between cancel */ \
+      if((i + 1) % KEY_SUBKEYS_NUM != 0 || i + 1 == rounds) \
+      { \
+        bs_t * const tmp = L; \
+        L = R; \
+        R = tmp; \
+      } \
+    } \
+    \
+    /* R16 L16 through IP^-1 */ \
+    for(size_t i = 0; i < BS_PLANES; ++i) \
+    { \
+      const size_t src = g_ip_reverse_table[i] - 1; \
+      planes[i] = src < 32 ? R[src] : L[src - 32]; \
+    } \
+    \
+    name##_transpose(planes); \
+    memcpy(words, planes, sizeof planes); \
+    bs_store(words, lanes, key_sched->whiten[op][1], out_blocks); \
+  }
+
+typedef void(*bs_crypt_fn)(const bs_key_sched_t * const, enum operation, const uint8_t * const, uint8_t *);
+
+BS_DEFINE_SBOX(bs_sbox, uint64_t, )
+BS_DEFINE_CIRCUITS(bs_circuit, uint64_t, )
+BS_DEFINE_ENGINE(bs_crypt, uint64_t, , bs_sbox, bs_circuit, g_bs_sbox_circuits)
+
+/*
+ *
+ *  The circuits only stand in for g_sboxes if they compute them. Plane j
+ *  of all 64 B chunk values has bit x set if bit j + 1 of chunk x is, so
+ *  a single pass through a circuit gives its whole truth table.
+ *
+ */
+static void bs_chunk_planes(uint64_t *chunks)
+{
+  for(size_t j = 0; j < 6; ++j)
+    chunks[j] = 0;
+
+  for(uint8_t x = 0; x < 64; ++x)
+  {
+    for(size_t j = 0; j < 6; ++j)
+      chunks[j] |= (uint64_t)(x >> (5 - j) & 0x01) << x;
+  }
+}
+
+static int bs_circuit_planes_match(size_t s, const uint64_t * const out)
+{
+  for(uint8_t x = 0; x < 64; ++x)
+  {
+    const uint8_t s_num = g_sboxes[s][MSG_SBOX_ROW_SIZE * msg_b_row_num(x) + msg_b_col_num(x)];
+    for(size_t o = 0; o < 4; ++o)
+    {
+      if((out[o] >> x & 0x01) != (s_num >> (3 - o) & 0x01))
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void bs_init(void)
+{
+  for(size_t s = 0; s < 8; ++s)
+  {
+    for(size_t o = 0; o < 4; ++o)
+    {
+      for(size_t q = 0; q < 16; ++q)
+      {
+        const size_t row = q >> 2;
+        const size_t col_hi = q & 0x03;
+
+        uint8_t truth_table = 0;
+        for(size_t col_lo = 0; col_lo < 4; ++col_lo)
+        {
+          const uint8_t s_num = g_sboxes[s][MSG_SBOX_ROW_SIZE * row + col_hi * 4 + col_lo];
+          truth_table |= (uint8_t)((s_num >> (3 - o) & 0x01) << col_lo);
+        }
+
+        g_bs_sbox_terms[s][o][q] = truth_table;
+      }
+    }
+  }
+
+  for(size_t i = 0; i < 32; ++i)
+    g_bs_p_dest[g_p_table[i] - 1] = (uint8_t)i;
+
+  void (* const circuits[8])(const uint64_t * const, uint64_t *) =
+  {
+    bs_circuit_s1, bs_circuit_s2, bs_circuit_s3, bs_circuit_s4,
+    bs_circuit_s5, bs_circuit_s6, bs_circuit_s7, bs_circuit_s8
+  };
+
+  uint64_t chunks[6];
+  bs_chunk_planes(chunks);
+
+  g_bs_sbox_circuits = 1;
+  for(size_t s = 0; s < 8; ++s)
+  {
+    uint64_t out[4];
+    circuits[s](chunks, out);
+    g_bs_sbox_circuits &= bs_circuit_planes_match(s, out);
+  }
+}
+
+#ifdef DES_X86
+
+#define BS_AVX2_BLOCKS (4 * BS_BLOCKS)
+#define BS_AVX512_BLOCKS (8 * BS_BLOCKS)
+
+#define BS_AVX2 __attribute__((target("avx2")))
+#define BS_AVX512 __attribute__((target("avx512f")))
+
+typedef uint64_t bs256_t __attribute__((vector_size(32)));
+typedef uint64_t bs512_t __attribute__((vector_size(64)));
+
+BS_DEFINE_SBOX(bs_sbox_avx2, bs256_t, BS_AVX2)
+BS_DEFINE_CIRCUITS(bs_circuit_avx2, bs256_t, BS_AVX2)
+BS_DEFINE_ENGINE(bs_crypt_avx2, bs256_t, BS_AVX2, bs_sbox_avx2, bs_circuit_avx2, g_bs_sbox_circuits)
+
+/*
+ *
+ *  vpternlog evaluates any function of three inputs given as an 8 bit
+ *  truth table, entry index being (a << 2 | b << 1 | c). In the DES
+ *  S-box circuits a gate is folded into its consumer whenever the
+ *  consumer still depends on three values at most, even if that means
+ *  computing a shared gate twice, NOT gates always fold. That leaves 251
+ *  instructions for all eight S-boxes instead of 448 gates. vpternlog
+ *  overwrites its first operand, so a value used for the last time goes
+ *  first, which keeps register copies down. The generic network for
+ *  S-boxes from --sbox-file gets every function of (b4, b5) and the
+ *  AND-OR accumulation in one instruction each, about 100 per S-box
+ *  instead of about 130 with plain operators.
+ *
+ */
+#define BS_TERNLOG(a, b, c, imm) ((bs512_t)_mm512_ternarylogic_epi64((__m512i)(a), (__m512i)(b), (__m512i)(c), (imm)))
+
+// (a & b) | c
+#define BS_TERNLOG_AND_OR 0xea
+
+// truth table of (b4, b5) function t spread over a, b with c ignored
+#define BS_TERNLOG_FUNC2(t) \
+  ((((t) >> 0 & 1) * 0x03) | (((t) >> 1 & 1) * 0x0c) | (((t) >> 2 & 1) * 0x30) | (((t) >> 3 & 1) * 0xc0))
+
+#define BS_TERNLOG_MINTERM(a, na, b, nb) \
+  BS_TERNLOG(a, b, b, (na ? 0x0f : 0xf0) & (nb ? 0x33 : 0xcc))
+
+BS_AVX512 static inline void bs_sbox_avx512(const bs512_t * const b, size_t s, bs512_t *out)
+{
+  const bs512_t row[4] =
+  {
+    BS_TERNLOG_MINTERM(b[0], 1, b[5], 1), BS_TERNLOG_MINTERM(b[0], 1, b[5], 0),
+    BS_TERNLOG_MINTERM(b[0], 0, b[5], 1), BS_TERNLOG_MINTERM(b[0], 0, b[5], 0)
+  };
+
+  const bs512_t col_hi[4] =
+  {
+    BS_TERNLOG_MINTERM(b[1], 1, b[2], 1), BS_TERNLOG_MINTERM(b[1], 1, b[2], 0),
+    BS_TERNLOG_MINTERM(b[1], 0, b[2], 1), BS_TERNLOG_MINTERM(b[1], 0, b[2], 0)
+  };
+
+  bs512_t minterm[16];
+  for(size_t q = 0; q < 16; ++q)
+    minterm[q] = row[q >> 2] & col_hi[q & 0x03];
+
+  const bs512_t func[16] =
+  {
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(0)),  BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(1)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(2)),  BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(3)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(4)),  BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(5)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(6)),  BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(7)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(8)),  BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(9)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(10)), BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(11)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(12)), BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(13)),
+    BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(14)), BS_TERNLOG(b[3], b[4], b[4], BS_TERNLOG_FUNC2(15))
+  };
+
+  for(size_t o = 0; o < 4; ++o)
+  {
+    const uint8_t * const terms = g_bs_sbox_terms[s][o];
+
+    bs512_t acc = minterm[0] & func[terms[0]];
+    for(size_t q = 1; q < 16; ++q)
+      acc = BS_TERNLOG(minterm[q], func[terms[q]], acc, BS_TERNLOG_AND_OR);
+
+    out[o] = acc;
+  }
+}
+
+/*
+ *
+ *  The circuits of BS_DEFINE_CIRCUITS with gates folded together, gate
+ *  numbers kept, the folded ones are gone.
+ *
+ */
+BS_AVX512 static inline void bs_circuit_avx512_s1(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x4 = BS_TERNLOG(a4, a3, a1, 0x69), x6 = BS_TERNLOG(a3, a1, a4, 0x51), x8 = BS_TERNLOG(x4, a6, x6, 0x1e);
+  const bs512_t x10 = BS_TERNLOG(a6, a4, a1, 0x70), x11 = BS_TERNLOG(a6, x6, x10, 0x56), x13 = BS_TERNLOG(x8, a2, x11, 0x1e);
+  const bs512_t x14 = BS_TERNLOG(a4, a1, x13, 0x95), x16 = BS_TERNLOG(a4, a6, x14, 0xe1), x18 = BS_TERNLOG(x14, a4, a3, 0x06);
+  const bs512_t x20 = BS_TERNLOG(x18, x16, a2, 0x36), x22 = BS_TERNLOG(x13, a5, x20, 0x1e);
+  out[3] = x22;
+
+  const bs512_t x25 = BS_TERNLOG(a6, a3, x4, 0xf1), x26 = x6 ^ x25, x28 = BS_TERNLOG(a2, a4, x8, 0xf2);
+  const bs512_t x31 = BS_TERNLOG(x6, a4, x8, 0x4b), x32 = BS_TERNLOG(a3, a1, x14, 0xa2), x34 = BS_TERNLOG(a2, x32, x8, 0x60);
+  const bs512_t x36 = BS_TERNLOG(x34, a5, x31, 0xde), x37 = BS_TERNLOG(x36, x26, x28, 0x96);
+  out[0] = x37;
+
+  const bs512_t x38 = a3 & x10, x40 = BS_TERNLOG(x32, a3, x8, 0x48), x42 = BS_TERNLOG(x25, a2, x40, 0xde);
+  const bs512_t x43 = BS_TERNLOG(x42, x38, x4, 0x1e), x45 = BS_TERNLOG(x14, a3, x26, 0x1e), x47 = BS_TERNLOG(x20, a1, x8, 0x1e);
+  const bs512_t x49 = BS_TERNLOG(x47, x45, a2, 0x36), x51 = BS_TERNLOG(x49, x43, a5, 0x6c);
+  out[1] = x51;
+
+  const bs512_t x54 = BS_TERNLOG(x11, a3, a1, 0x1c), x55 = a2 | x54, x56 = BS_TERNLOG(x55, x8, x40, 0x96);
+  const bs512_t x58 = BS_TERNLOG(x38, a6, x4, 0x1e), x59 = x13 & x56, x61 = BS_TERNLOG(x59, x58, a2, 0x6c);
+  const bs512_t x63 = BS_TERNLOG(x61, x56, a5, 0x6c);
+  out[2] = x63;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s2(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x4 = BS_TERNLOG(a5, a6, a1, 0x69), x5 = x4 ^ a2, x7 = BS_TERNLOG(a6, a5, a1, 0xf7);
+  const bs512_t x9 = BS_TERNLOG(x7, a6, a2, 0x6c), x11 = BS_TERNLOG(x5, a3, x9, 0x78), x13 = BS_TERNLOG(a5, a6, a6, 0x3f);
+  const bs512_t x14 = a3 | x13, x15 = BS_TERNLOG(x14, a2, x9, 0x78), x17 = BS_TERNLOG(x11, a4, x15, 0x78);
+  out[1] = x17;
+
+  const bs512_t x19 = BS_TERNLOG(a6, a5, a1, 0xfe), x21 = BS_TERNLOG(x13, x19, a2, 0x96), x23 = BS_TERNLOG(x4, a6, x17, 0xa8);
+  const bs512_t x25 = BS_TERNLOG(x23, x21, a3, 0x36), x26 = BS_TERNLOG(a6, a1, a1, 0xf3), x28 = BS_TERNLOG(a2, a5, a1, 0xf4);
+  const bs512_t x30 = BS_TERNLOG(a5, a6, a1, 0x6c), x32 = BS_TERNLOG(a2, a1, x19, 0x90), x34 = BS_TERNLOG(a3, x30, x32, 0x60);
+  const bs512_t x35 = BS_TERNLOG(x34, x26, x28, 0x96), x37 = BS_TERNLOG(x35, x25, a4, 0x36);
+  out[2] = x37;
+
+  const bs512_t x39 = BS_TERNLOG(x5, x21, x32, 0x78), x41 = BS_TERNLOG(x13, a1, x15, 0x1e), x43 = BS_TERNLOG(x39, a3, x41, 0x1e);
+  const bs512_t x45 = BS_TERNLOG(x41, a4, x28, 0xc8), x46 = x43 ^ x45;
+  out[0] = x46;
+
+  const bs512_t x48 = BS_TERNLOG(x26, x19, x21, 0x78), x49 = BS_TERNLOG(x32, a2, x30, 0x48), x50 = x49 ^ x21;
+  const bs512_t x52 = BS_TERNLOG(x48, a3, x50, 0x78), x53 = BS_TERNLOG(x28, a5, a1, 0xe0), x55 = BS_TERNLOG(x50, a4, x53, 0xec);
+  const bs512_t x56 = x52 ^ x55;
+  out[3] = x56;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s3(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x4 = BS_TERNLOG(a5, a3, a6, 0x6a), x5 = a4 & ~a5, x7 = BS_TERNLOG(x4, x5, a2, 0x96);
+  const bs512_t x8 = a3 & ~a5, x9 = BS_TERNLOG(a5, a6, a6, 0xc3), x10 = a4 | x9;
+  const bs512_t x12 = BS_TERNLOG(x7, x8, x10, 0x60), x13 = BS_TERNLOG(a5, x8, x10, 0x96), x15 = BS_TERNLOG(a4, x13, x7, 0xe0);
+  const bs512_t x17 = BS_TERNLOG(a2, x12, x15, 0x60), x18 = BS_TERNLOG(x17, x8, x10, 0x96), x20 = BS_TERNLOG(x18, x7, a1, 0x6c);
+  out[3] = x20;
+
+  const bs512_t x21 = a3 ^ a4, x24 = BS_TERNLOG(a6, x4, x8, 0x65), x25 = a2 | x24;
+  const bs512_t x26 = BS_TERNLOG(x25, x21, x9, 0x96), x27 = BS_TERNLOG(a6, x4, x4, 0x3f), x29 = a3 ^ x15;
+  const bs512_t x31 = BS_TERNLOG(a2, x29, x5, 0xfe), x32 = BS_TERNLOG(x31, x27, a4, 0x1e), x34 = BS_TERNLOG(x32, x26, a1, 0x36);
+  out[0] = x34;
+
+  const bs512_t x36 = BS_TERNLOG(x9, a3, x5, 0xbe), x38 = BS_TERNLOG(x29, x4, a4, 0x56), x40 = BS_TERNLOG(x36, a2, x38, 0x1e);
+  const bs512_t x41 = BS_TERNLOG(x10, a6, x8, 0x48), x42 = BS_TERNLOG(x5, x41, x4, 0xde), x44 = BS_TERNLOG(x41, x34, x38, 0x96);
+  const bs512_t x46 = BS_TERNLOG(x44, x42, a2, 0x6c), x48 = BS_TERNLOG(x46, x40, a1, 0x36);
+  out[2] = x48;
+
+  const bs512_t x50 = BS_TERNLOG(x13, a6, x38, 0x4b), x52 = BS_TERNLOG(x27, a2, a4, 0xce), x54 = BS_TERNLOG(x4, x12, a6, 0xc4);
+  const bs512_t x56 = BS_TERNLOG(x54, a1, x52, 0xec), x57 = BS_TERNLOG(x56, x50, x52, 0x96);
+  out[1] = x57;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s4(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x5 = BS_TERNLOG(a1, a5, a3, 0xc7), x7 = BS_TERNLOG(x5, a2, a3, 0x1e), x9 = BS_TERNLOG(a1, a5, a3, 0x3a);
+  const bs512_t x11 = BS_TERNLOG(a5, a2, x9, 0x78), x13 = BS_TERNLOG(x7, a4, x11, 0x78), x14 = BS_TERNLOG(a3, a5, a1, 0xc7);
+  const bs512_t x16 = BS_TERNLOG(x9, a2, x14, 0x78), x19 = BS_TERNLOG(a2, a5, a3, 0xf9), x20 = BS_TERNLOG(x5, x14, x19, 0x6a);
+  const bs512_t x22 = BS_TERNLOG(x20, x16, a4, 0x36), x24 = BS_TERNLOG(x13, a6, x22, 0x78);
+  out[1] = x24;
+
+  const bs512_t x26 = a6 | x22, x27 = BS_TERNLOG(x13, x26, x26, 0xc3);
+  out[0] = x27;
+
+  const bs512_t x28 = a2 & x11, x29 = BS_TERNLOG(x14, x28, x5, 0x6c), x30 = BS_TERNLOG(x9, a3, a2, 0x6c);
+  const bs512_t x32 = BS_TERNLOG(x19, a4, x30, 0x48), x33 = x29 ^ x32, x34 = BS_TERNLOG(x13, x33, x33, 0xc3);
+  const bs512_t x36 = BS_TERNLOG(x24, a2, x34, 0x78), x38 = BS_TERNLOG(x34, x36, a4, 0x36), x40 = BS_TERNLOG(x33, a6, x38, 0x78);
+  out[3] = x40;
+
+  const bs512_t x42 = BS_TERNLOG(x38, x26, x40, 0x96);
+  out[2] = x42;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s5(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x4 = BS_TERNLOG(a6, a3, a4, 0x95), x5 = BS_TERNLOG(a1, a6, a3, 0x70), x7 = a6 | a4;
+  const bs512_t x10 = BS_TERNLOG(a1, a3, x7, 0xfe), x11 = BS_TERNLOG(x7, a3, x10, 0x96), x12 = a5 & x11;
+  const bs512_t x13 = BS_TERNLOG(x12, x4, x5, 0x96), x16 = BS_TERNLOG(a1, x4, a6, 0xf2), x17 = BS_TERNLOG(x7, a3, x16, 0x96);
+  const bs512_t x19 = BS_TERNLOG(x17, x10, a5, 0x36), x21 = BS_TERNLOG(x13, a2, x19, 0x1e);
+  out[2] = x21;
+
+  const bs512_t x22 = BS_TERNLOG(a3, x4, a6, 0x2f), x23 = x22 ^ a6, x25 = BS_TERNLOG(a1, a4, x22, 0x60);
+  const bs512_t x27 = a1 ^ x11, x29 = BS_TERNLOG(a5, x27, x22, 0xf8), x30 = BS_TERNLOG(x29, x23, x25, 0x96);
+  const bs512_t x33 = BS_TERNLOG(a2, a4, x27, 0xf1), x34 = x30 ^ x33;
+  out[1] = x34;
+
+  const bs512_t x35 = BS_TERNLOG(a3, x4, a6, 0x2d), x37 = BS_TERNLOG(x35, x4, a1, 0x93), x39 = BS_TERNLOG(x7, x5, x34, 0x28);
+  const bs512_t x41 = BS_TERNLOG(x39, x37, a5, 0x36), x43 = BS_TERNLOG(a3, x5, x16, 0x82), x44 = x4 & x27;
+  const bs512_t x46 = BS_TERNLOG(x44, x43, a5, 0x6c), x48 = BS_TERNLOG(x46, x41, a2, 0x36);
+  out[0] = x48;
+
+  const bs512_t x49 = BS_TERNLOG(x22, a4, x48, 0x28), x50 = x49 ^ x5, x51 = x11 ^ x30;
+  const bs512_t x54 = BS_TERNLOG(x51, x50, a5, 0x64), x56 = BS_TERNLOG(x19, x4, x34, 0x69), x58 = BS_TERNLOG(x30, x4, x16, 0x60);
+  const bs512_t x60 = BS_TERNLOG(x58, x56, a5, 0x6c), x62 = BS_TERNLOG(x60, x54, a2, 0x36);
+  out[3] = x62;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s6(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x3 = a2 ^ a6, x5 = BS_TERNLOG(x3, a5, a1, 0x69), x6 = a5 & a6;
+  const bs512_t x7 = BS_TERNLOG(x6, a2, a2, 0xf3), x8 = a5 & x5, x10 = BS_TERNLOG(x7, a1, x8, 0x78);
+  const bs512_t x12 = BS_TERNLOG(x5, a4, x10, 0x78), x14 = BS_TERNLOG(x10, a6, a1, 0x28), x16 = BS_TERNLOG(a2, a6, a5, 0x6a);
+  const bs512_t x18 = BS_TERNLOG(a5, a1, x16, 0x87), x20 = BS_TERNLOG(x14, a4, x18, 0x1e), x22 = BS_TERNLOG(x20, x12, a3, 0x6c);
+  out[1] = x22;
+
+  const bs512_t x24 = BS_TERNLOG(a1, a6, x18, 0x60), x26 = BS_TERNLOG(a2, a1, x16, 0x78), x28 = BS_TERNLOG(a4, x26, x6, 0xe0);
+  const bs512_t x29 = BS_TERNLOG(x28, a5, x24, 0x96), x31 = a6 | x29, x34 = BS_TERNLOG(x26, a4, x31, 0x4b);
+  const bs512_t x36 = BS_TERNLOG(x29, a3, x34, 0x78);
+  out[3] = x36;
+
+  const bs512_t x38 = BS_TERNLOG(x18, a5, a6, 0x48), x40 = BS_TERNLOG(a4, x38, x5, 0xf6), x41 = BS_TERNLOG(x40, x6, x34, 0x96);
+  const bs512_t x43 = BS_TERNLOG(x16, x24, a2, 0xa9), x44 = BS_TERNLOG(x24, a2, a6, 0x78), x46 = BS_TERNLOG(x44, a4, x31, 0xde);
+  const bs512_t x48 = BS_TERNLOG(x46, a3, x43, 0xde), x49 = x41 ^ x48;
+  out[0] = x49;
+
+  const bs512_t x51 = BS_TERNLOG(x6, x5, x38, 0x1e), x53 = BS_TERNLOG(x31, a4, x8, 0xec), x56 = BS_TERNLOG(x43, a3, x26, 0xdc);
+  const bs512_t x57 = BS_TERNLOG(x56, x51, x53, 0x96);
+  out[2] = x57;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s7(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x4 = BS_TERNLOG(a2, a4, a5, 0x6a), x6 = a4 & x4, x8 = BS_TERNLOG(a3, x6, a2, 0x60);
+  const bs512_t x10 = BS_TERNLOG(a6, a1, x8, 0xf6), x11 = BS_TERNLOG(x10, x4, a3, 0x96), x12 = a4 & ~a5;
+  const bs512_t x15 = BS_TERNLOG(a3, a2, a5, 0xd0), x16 = BS_TERNLOG(x12, a2, x15, 0x56), x18 = BS_TERNLOG(a6, x6, x11, 0xf6);
+  const bs512_t x19 = x16 ^ x18, x21 = BS_TERNLOG(x11, a1, x19, 0x78);
+  out[0] = x21;
+
+  const bs512_t x23 = BS_TERNLOG(a2, x21, x6, 0x56), x24 = x23 ^ x15, x25 = BS_TERNLOG(x4, a3, x6, 0x96);
+  const bs512_t x26 = x25 | x12, x28 = BS_TERNLOG(x24, a6, x26, 0x1e), x31 = BS_TERNLOG(x26, a6, x23, 0x80);
+  const bs512_t x32 = BS_TERNLOG(x31, a2, x19, 0xd2), x34 = BS_TERNLOG(x32, x28, a1, 0x36);
+  out[3] = x34;
+
+  const bs512_t x36 = BS_TERNLOG(x16, a4, a2, 0xd5), x38 = BS_TERNLOG(x36, x11, a6, 0x6c), x39 = BS_TERNLOG(x12, a4, a2, 0xc8);
+  const bs512_t x40 = BS_TERNLOG(a3, x6, a2, 0xf6), x43 = BS_TERNLOG(x24, a6, a2, 0xfd), x44 = BS_TERNLOG(x43, x39, x40, 0x96);
+  const bs512_t x46 = BS_TERNLOG(x38, a1, x44, 0x1e);
+  out[1] = x46;
+
+  const bs512_t x49 = BS_TERNLOG(x15, a6, x6, 0xde), x50 = BS_TERNLOG(x49, x8, x44, 0x96), x51 = x19 ^ x44;
+  const bs512_t x53 = BS_TERNLOG(x25, x46, a4, 0x48), x55 = BS_TERNLOG(x53, x51, a6, 0x6c), x57 = BS_TERNLOG(x55, x50, a1, 0x36);
+  out[2] = x57;
+}
+
+BS_AVX512 static inline void bs_circuit_avx512_s8(const bs512_t * const b, bs512_t *out)
+{
+  const bs512_t a1 = b[0], a2 = b[1], a3 = b[2], a4 = b[3], a5 = b[4], a6 = b[5];
+
+  const bs512_t x3 = BS_TERNLOG(a3, a1, a1, 0xc3), x5 = BS_TERNLOG(a3, a1, a4, 0xa6), x7 = BS_TERNLOG(x3, a5, x5, 0x1e);
+  const bs512_t x8 = BS_TERNLOG(a1, x5, x5, 0xcf), x9 = BS_TERNLOG(a4, x8, x8, 0xc3), x11 = BS_TERNLOG(x8, a5, x9, 0x78);
+  const bs512_t x13 = BS_TERNLOG(x11, x7, a2, 0x6c), x14 = BS_TERNLOG(a5, x5, x9, 0x56), x15 = x3 & x9;
+  const bs512_t x17 = BS_TERNLOG(x15, a5, x8, 0x78), x19 = BS_TERNLOG(x17, x14, a2, 0x36), x21 = BS_TERNLOG(x13, a6, x19, 0x1e);
+  out[0] = x21;
+
+  const bs512_t x23 = BS_TERNLOG(a5, x3, a4, 0x54), x26 = BS_TERNLOG(a5, a3, a1, 0xd0), x27 = BS_TERNLOG(x26, a3, x8, 0xd2);
+  const bs512_t x29 = BS_TERNLOG(x27, x23, a2, 0x36), x31 = BS_TERNLOG(x13, a6, x29, 0x78);
+  out[3] = x31;
+
+  const bs512_t x33 = BS_TERNLOG(x5, a5, x3, 0xe2), x35 = BS_TERNLOG(x13, a2, a4, 0xc8), x36 = x33 ^ x35;
+  const bs512_t x38 = BS_TERNLOG(x33, a1, x8, 0x6a), x40 = BS_TERNLOG(x23, a1, x7, 0x28), x42 = BS_TERNLOG(x40, x38, a2, 0x6c);
+  const bs512_t x44 = BS_TERNLOG(x42, x36, a6, 0x36);
+  out[2] = x44;
+
+  const bs512_t x45 = BS_TERNLOG(x9, a1, a5, 0x6c), x46 = BS_TERNLOG(x3, x45, a5, 0x36), x48 = x8 & ~x7;
+  const bs512_t x50 = BS_TERNLOG(x48, x46, a2, 0x36), x52 = BS_TERNLOG(x38, x19, x29, 0xf6), x54 = BS_TERNLOG(x52, x50, a6, 0x6c);
+  out[1] = x54;
+}
+
+
+BS_AVX512 static void bs_init_avx512(void)
+{
+  // the folded gates share no code with BS_DEFINE_CIRCUITS, every lane of them is checked, the generic network stands in on a mismatch
+
+  void (* const circuits[8])(const bs512_t * const, bs512_t *) =
+  {
+    bs_circuit_avx512_s1, bs_circuit_avx512_s2, bs_circuit_avx512_s3, bs_circuit_avx512_s4,
+    bs_circuit_avx512_s5, bs_circuit_avx512_s6, bs_circuit_avx512_s7, bs_circuit_avx512_s8
+  };
+
+  uint64_t chunks[6];
+  bs_chunk_planes(chunks);
+
+  bs512_t planes[6];
+  for(size_t j = 0; j < 6; ++j)
+  {
+    for(size_t lane = 0; lane < 8; ++lane)
+      planes[j][lane] = chunks[j];
+  }
+
+  g_bs_sbox_circuits_avx512 = 1;
+  for(size_t s = 0; s < 8; ++s)
+  {
+    bs512_t out[4];
+    circuits[s](planes, out);
+
+    for(size_t lane = 0; lane < 8; ++lane)
+    {
+      const uint64_t lane_out[4] = { out[0][lane], out[1][lane], out[2][lane], out[3][lane] };
+      g_bs_sbox_circuits_avx512 &= bs_circuit_planes_match(s, lane_out);
+    }
+  }
+}
+
+BS_DEFINE_ENGINE(bs_crypt_avx512, bs512_t, BS_AVX512, bs_sbox_avx512, bs_circuit_avx512, g_bs_sbox_circuits_avx512)
+
+/*
+ *
+ *  Gather engine, the table kernel with one block per 32 bit lane. Eight
+ *  blocks is all it needs to run, so it covers short batches the
+ *  bitsliced engines can't take. Every SP lookup is a vpgatherdd from
+ *  the same g_sp_tables the scalar kernel uses.
+ *
+ */
+#define FAST_GATHER_BLOCKS 8
+
+BS_AVX2 static inline __m256i fast_rotl_avx2(__m256i val, int shift)
+{
+  return _mm256_or_si256(_mm256_slli_epi32(val, shift), _mm256_srli_epi32(val, 32 - shift));
+}
+
+BS_AVX2 static inline __m256i fast_f_avx2(__m256i r, const uint32_t * const subkey)
+{
+  const __m256i chunk_mask = _mm256_set1_epi32(0x3f);
+  const __m256i a = _mm256_xor_si256(r, _mm256_set1_epi32((int)subkey[0]));
+  const __m256i b = _mm256_xor_si256(fast_rotl_avx2(r, 4), _mm256_set1_epi32((int)subkey[1]));
+
+  __m256i ret = _mm256_i32gather_epi32((const int *)g_sp_tables[0], _mm256_srli_epi32(a, 26), 4);
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[1], _mm256_srli_epi32(b, 26), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[2], _mm256_and_si256(_mm256_srli_epi32(a, 18), chunk_mask), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[3], _mm256_and_si256(_mm256_srli_epi32(b, 18), chunk_mask), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[4], _mm256_and_si256(_mm256_srli_epi32(a, 10), chunk_mask), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[5], _mm256_and_si256(_mm256_srli_epi32(b, 10), chunk_mask), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[6], _mm256_and_si256(_mm256_srli_epi32(a, 2), chunk_mask), 4));
+  ret = _mm256_xor_si256(ret, _mm256_i32gather_epi32((const int *)g_sp_tables[7], _mm256_and_si256(_mm256_srli_epi32(b, 2), chunk_mask), 4));
+
+  return ret;
+}
+
+BS_AVX2 static void fast_crypt_blocks_avx2(const fast_key_sched_t * const key_sched, enum operation op, const uint8_t * const msg_blocks, uint8_t *out_blocks)
+{
+  const uint32_t (* const subkeys)[2] = key_sched->subkeys[op];
+
+  uint32_t halves[2][FAST_GATHER_BLOCKS];
+  for(size_t n = 0; n < FAST_GATHER_BLOCKS; ++n)
+  {
+    const uint64_t ip = perm_ip(fast_load_block(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE) ^ key_sched->whiten[op][0]);
+    halves[0][n] = fast_rotl((uint32_t)(ip >> 32), 31);
+    halves[1][n] = fast_rotl((uint32_t)ip, 31);
+  }
+
+  __m256i L = _mm256_loadu_si256((const __m256i *)halves[0]);
+  __m256i R = _mm256_loadu_si256((const __m256i *)halves[1]);
+
+  for(size_t i = 0; i < key_sched->stages * KEY_SUBKEYS_NUM; i += 2)
+  {
+    // halves swap roles between 3DES stages, see fast_crypt_block
+    if(i && i % KEY_SUBKEYS_NUM == 0)
+    {
+      const __m256i tmp = L;
+      L = R;
+      R = tmp;
+    }
+
+    L = _mm256_xor_si256(L, fast_f_avx2(R, subkeys[i]));
+    R = _mm256_xor_si256(R, fast_f_avx2(L, subkeys[i + 1]));
+  }
+
+  _mm256_storeu_si256((__m256i *)halves[0], L);
+  _mm256_storeu_si256((__m256i *)halves[1], R);
+
+  for(size_t n = 0; n < FAST_GATHER_BLOCKS; ++n)
+  {
+    const uint64_t final_RL = (uint64_t)fast_rotl(halves[1][n], 1) << 32 | fast_rotl(halves[0][n], 1);
+    fast_store_block(perm_ip_reverse(final_RL) ^ key_sched->whiten[op][1], out_blocks + n * MSG_SINGLE_BLOCK_SIZE);
+  }
+}
+
+static int bs_avx2_supported(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int bs_avx512_supported(void)
+{
+  return __builtin_cpu_supports("avx512f");
+}
+
+#endif
+
+/*
+ *
+ *  Engines in order of preference, bound once per job. Batch engines
+ *  take whole groups of blocks, bitsliced or in lanes, and come largest
+ *  batch first. By default every supported one runs in turn on what the
+ *  previous left over, so short inputs still get the small batch
+ *  engines, and the table engine does the last blocks one by one. One
+ *  whose batch is not smaller than the one of the engine before would
+ *  never get any blocks, it is left out of the default cascade and only
+ *  runs through --engine, as pair4 does behind table4. A forced engine
+ *  runs alone before the table engine. The illustrated reference engine
+ *  goes block by block.
+ *
+ *  With the S-box circuits the portable bitsliced engine is the fastest
+ *  one without AVX2, ahead of gather and the table kernels on --bench.
+ *  Pair tables lose to the 6 bit ones on the cores measured so far,
+ *  building with DES_PREFER_SP_PAIRS defined moves them in front and
+ *  leaves table4 to --engine.
+ *
+ */
+#define ENGINES_MAX 8
+
+typedef struct
+{
+  const char *name;
+  int (*supported)(void);
+  bs_crypt_fn bs_batch;
+  fast_batch_fn table_batch;
+  size_t batch_blocks;
+  int illustrated;
+} engine_t;
+
+static int engine_always_supported(void)
+{
+  return 1;
+}
+
+static const engine_t g_engines[] =
+{
+#ifdef DES_X86
+  { "avx512",    bs_avx512_supported,     bs_crypt_avx512, NULL,                   BS_AVX512_BLOCKS,       0 },
+  { "avx2",      bs_avx2_supported,       bs_crypt_avx2,   NULL,                   BS_AVX2_BLOCKS,         0 },
+#endif
+  { "bs64",      engine_always_supported, bs_crypt,        NULL,                   BS_BLOCKS,              0 },
+#ifdef DES_X86
+  { "gather",    bs_avx2_supported,       NULL,            fast_crypt_blocks_avx2, FAST_GATHER_BLOCKS,     0 },
+#endif
+#ifdef DES_PREFER_SP_PAIRS
+  { "pair4",     engine_always_supported, NULL,            fast_crypt_blocks_pair, FAST_INTERLEAVE_BLOCKS, 0 },
+#endif
+  { "table4",    engine_always_supported, NULL,            fast_crypt_blocks,      FAST_INTERLEAVE_BLOCKS, 0 },
+#ifndef DES_PREFER_SP_PAIRS
+  { "pair4",     engine_always_supported, NULL,            fast_crypt_blocks_pair, FAST_INTERLEAVE_BLOCKS, 0 },
+#endif
+  { "table",     engine_always_supported, NULL,            NULL,                   0,                      0 },
+  { "reference", engine_always_supported, NULL,            NULL,                   0,                      1 }
+};
+
+static size_t engine_select(const char *name, int quiet, const engine_t **selected)
+{
+  // illustrated output is the point of the verbose mode
+
+  if(!*name && !quiet)
+    name = "reference";
+
+#ifdef DES_X86
+  __builtin_cpu_init();
+#endif
+
+  size_t selected_num = 0;
+  for(size_t i = 0; i < sizeof g_engines / sizeof g_engines[0] && selected_num < ENGINES_MAX; ++i)
+  {
+    const engine_t * const engine = &g_engines[i];
+
+    // the engine before leaves fewer blocks than one batch of this one
+    const int unreachable = selected_num && engine->batch_blocks && engine->batch_blocks >= selected[selected_num - 1]->batch_blocks;
+    if(!*name && !engine->illustrated && !unreachable && engine->supported())
+      selected[selected_num++] = engine;
+
+    if(*name && strcmp(name, engine->name) == 0)
+    {
+      if(engine->supported())
+      {
+        selected[0] = engine;
+        return 1;
+      }
+
+      printf("engine '%s' is not supported by this CPU\n", name);
+      return 0;
+    }
+  }
+
+  if(!selected_num)
+  {
+    printf("unknown engine '%s'\n\n", name);
+    usage();
+  }
+
+  return selected_num;
+}
+
+static void engine_run_batch(const engine_t * const engine, const fast_key_sched_t * const key_sched, const bs_key_sched_t * const bs_key_sched_buff, enum operation op, const uint8_t * const msg_blocks, uint8_t *out_blocks)
+{
+  if(engine->bs_batch)
+    engine->bs_batch(bs_key_sched_buff, op, msg_blocks, out_blocks);
+  else if(engine->table_batch)
+    engine->table_batch(key_sched, op, msg_blocks, out_blocks);
+  else if(op == encrypt)
+    fast_encrypt_block(key_sched, msg_blocks, out_blocks);
+  else
+    fast_decrypt_block(key_sched, msg_blocks, out_blocks);
+}
+
+static int engine_verify(const uint8_t * const msg_blocks, const uint8_t * const out_blocks, size_t first_block, size_t blocks_num, const key_set_t * const key_set, enum operation op, size_t sample, size_t *mismatch_block)
+{
+  // blocks with index divisible by sample, counted from the start of the data file, silent so it can run on the job threads
+
+  for(size_t n = (sample - first_block % sample) % sample; n < blocks_num; n += sample)
+  {
+    uint8_t reference[MSG_SINGLE_BLOCK_SIZE] = {0};
+    msg_ede_reference(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE, key_set, op, reference);
+    if(memcmp(reference, out_blocks + n * MSG_SINGLE_BLOCK_SIZE, MSG_SINGLE_BLOCK_SIZE) != 0)
+    {
+      *mismatch_block = first_block + n;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void engine_verify_report(size_t mismatch_block, const char *engine_name)
+{
+  // from the main thread only, after the threads that verified are done
+
+  trace_flush();
+  printf("block %zu of engine '%s' differs from the reference engine, aborting\n", mismatch_block, engine_name);
+}
+
+/*
+ *
+ *  Multithreaded ECB. Whole blocks are split in block aligned chunks, one per
+ *  thread, each going through the same engine cascade as the serial loop
+ *  into its own part of a shared output buffer. Key schedules are only read.
+ *
+ */
+
+/*
+ *
+ *  Counter mode. Keystream block i is the encryption of IV + i, the IV
+ *  taken as a big endian 64 bit counter. Blocks don't depend on each other,
+ *  so counter blocks go through the batch engines and the threads just as
+ *  ECB blocks do, and any byte offset of the stream can be processed without
+ *  its prefix. There is no padding, the output is as long as the input.
+ *
+ */
+
+static void ctr_fill(uint64_t counter, size_t blocks_num, uint8_t *counter_blocks)
+{
+  for(size_t n = 0; n < blocks_num; ++n)
+    fast_store_block(counter + n, counter_blocks + n * MSG_SINGLE_BLOCK_SIZE);
+}
+
+typedef struct
+{
+  const engine_t * const *engines;
+  size_t engines_num;
+  const fast_key_sched_t *key_sched;
+  const bs_key_sched_t *bs_key_sched_buff;
+  const key_set_t *key_set;
+  enum operation op;
+  size_t verify_sample;
+  int illustrated;
+
+  // ctr, counter and stream block index of the first block of msg_blocks
+  enum cipher_mode mode;
+  uint64_t counter;
+  size_t block_base;
+
+  // cbc and cfb decryption, chained on the block before msg_blocks, the IV for the first one
+  const uint8_t *iv;
+
+  const uint8_t *msg_blocks;
+  uint8_t *out_blocks;
+  size_t first_block;
+  size_t last_block;
+
+  // first sample that failed verification, reported by the caller
+  int ok;
+  size_t mismatch_block;
+  const char *mismatch_engine;
+} engine_job_t;
+
+static int engine_job_blocks(engine_job_t * const job, const engine_t * const engine, size_t first_block, size_t blocks_num)
+{
+  // a batch engine, or a single block through the table or the illustrated engine without one
+
+  const uint8_t *msg_blocks = job->msg_blocks + first_block * MSG_SINGLE_BLOCK_SIZE;
+  uint8_t *out_blocks = job->out_blocks + first_block * MSG_SINGLE_BLOCK_SIZE;
+
+  // ctr runs the engines on counter blocks and XORs the keystream in afterwards
+  uint8_t counter_blocks[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  uint8_t keystream[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  if(job->mode == mode_ctr)
+  {
+    ctr_fill(job->counter + first_block, blocks_num, counter_blocks);
+    msg_blocks = counter_blocks;
+    out_blocks = keystream;
+  }
+  else if(job->mode == mode_cfb)
+  {
+    // cfb decryption the same way on the ciphertext one block back, the IV ahead of the first block
+    if(first_block)
+    {
+      msg_blocks -= MSG_SINGLE_BLOCK_SIZE;
+    }
+    else
+    {
+      memcpy(counter_blocks, job->iv, MSG_SINGLE_BLOCK_SIZE);
+      memcpy(counter_blocks + MSG_SINGLE_BLOCK_SIZE, msg_blocks, (blocks_num - 1) * MSG_SINGLE_BLOCK_SIZE);
+      msg_blocks = counter_blocks;
+    }
+
+    out_blocks = keystream;
+  }
+
+  if(engine)
+  {
+    engine_run_batch(engine, job->key_sched, job->bs_key_sched_buff, job->op, msg_blocks, out_blocks);
+  }
+  else if(job->illustrated)
+  {
+    memset(out_blocks, 0x00, MSG_SINGLE_BLOCK_SIZE);
+    msg_ede_block(msg_blocks, job->key_set, job->op, out_blocks);
+  }
+  else if(job->op == encrypt)
+  {
+    fast_encrypt_block(job->key_sched, msg_blocks, out_blocks);
+  }
+  else
+  {
+    fast_decrypt_block(job->key_sched, msg_blocks, out_blocks);
+  }
+
+  if(job->verify_sample && !engine_verify(msg_blocks, out_blocks, job->block_base + first_block, blocks_num, job->key_set, job->op, job->verify_sample, &job->mismatch_block))
+  {
+    job->mismatch_engine = engine ? engine->name : "table";
+    return 0;
+  }
+
+  if(job->mode == mode_ctr || job->mode == mode_cfb)
+  {
+    const size_t offset = first_block * MSG_SINGLE_BLOCK_SIZE;
+    for(size_t i = 0; i < blocks_num * MSG_SINGLE_BLOCK_SIZE; ++i)
+      job->out_blocks[offset + i] = job->msg_blocks[offset + i] ^ keystream[i];
+  }
+  else if(job->mode == mode_cbc)
+  {
+    // P i = D(C i) ^ C i-1, only ciphertext is read so the chunks don't depend on each other
+
+    const uint8_t * const prev = first_block ? msg_blocks - MSG_SINGLE_BLOCK_SIZE : job->iv;
+    for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+      out_blocks[i] ^= prev[i];
+
+    for(size_t i = MSG_SINGLE_BLOCK_SIZE; i < blocks_num * MSG_SINGLE_BLOCK_SIZE; ++i)
+      out_blocks[i] ^= msg_blocks[i - MSG_SINGLE_BLOCK_SIZE];
+  }
+
+  return 1;
+}
+
+static void *engine_job_run(void *arg)
+{
+  engine_job_t * const job = (engine_job_t*)arg;
+  job->ok = 0;
+
+  size_t it = job->first_block;
+  for(size_t e = 0; e < job->engines_num; ++e)
+  {
+    const engine_t * const engine = job->engines[e];
+    for(; engine->batch_blocks && it + engine->batch_blocks <= job->last_block; it += engine->batch_blocks)
+    {
+      if(!engine_job_blocks(job, engine, it, engine->batch_blocks))
+        return NULL;
+    }
+  }
+
+  // the rest of the chunk block by block, same as the tail of the serial loop
+  for(; it < job->last_block; ++it)
+  {
+    if(!engine_job_blocks(job, NULL, it, 1))
+      return NULL;
+  }
+
+  job->ok = 1;
+  return NULL;
+}
+
+static int engine_run_jobs(engine_job_t job, size_t jobs_num, size_t blocks_num)
+{
+  // chunks are whole batches of the first engine so every thread keeps it busy, single block engines split evenly
+
+  pthread_t threads[ARG_JOBS_MAX];
+  engine_job_t jobs[ARG_JOBS_MAX];
+  int started[ARG_JOBS_MAX] = {0};
+
+  const size_t batch = job.engines[0]->batch_blocks ? job.engines[0]->batch_blocks : 1;
+  const size_t chunk = ((blocks_num + jobs_num - 1) / jobs_num + batch - 1) / batch * batch;
+  for(size_t j = 0; j < jobs_num; ++j)
+  {
+    jobs[j] = job;
+    jobs[j].first_block = j * chunk < blocks_num ? j * chunk : blocks_num;
+    jobs[j].last_block = (j + 1) * chunk < blocks_num ? (j + 1) * chunk : blocks_num;
+
+    // the caller's thread takes over whatever could not be started
+    started[j] = j > 0 && pthread_create(&threads[j], NULL, engine_job_run, &jobs[j]) == 0;
+  }
+
+  engine_job_run(&jobs[0]);
+  for(size_t j = 1; j < jobs_num; ++j)
+  {
+    if(started[j])
+      pthread_join(threads[j], NULL);
+    else
+      engine_job_run(&jobs[j]);
+  }
+
+  // the lowest failing chunk holds the first mismatch
+  for(size_t j = 0; j < jobs_num; ++j)
+  {
+    if(!jobs[j].ok)
+    {
+      engine_verify_report(jobs[j].mismatch_block, jobs[j].mismatch_engine);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static char *trace_put_str(char *str, const char *text)
+{
+  while(*text)
+    *str++ = *text++;
+
+  return str;
+}
+
+static char *trace_put_hex(char *str, const uint8_t * const buffer, size_t size)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+
+  *str++ = '"';
+  for(size_t i = 0; i < size; ++i)
+  {
+    *str++ = hex_digits[buffer[i] >> 4];
+    *str++ = hex_digits[buffer[i] & 0x0f];
+  }
+  *str++ = '"';
+
+  return str;
+}
+
+static char *trace_put_field(char *str, const char *separator, const char *name, const uint8_t * const buffer, size_t size)
+{
+  str = trace_put_str(str, separator);
+  str = trace_put_str(str, "\"");
+  str = trace_put_str(str, name);
+  str = trace_put_str(str, "\":");
+
+  return trace_put_hex(str, buffer, size);
+}
+
+// longest JSON line a record can take, hex doubles every byte
+#define TRACE_JSON_LINE_SIZE (4 * TRACE_RECORD_SIZE + 64 * KEY_SUBKEYS_NUM + 256)
+
+static void trace_write_record(const trace_record_t * const record, enum operation op)
+{
+  if(g_app_arg.trace_format == trace_binary)
+  {
+    fwrite(record, 1, TRACE_RECORD_SIZE, g_trace_file);
+    return;
+  }
+
+  char line[TRACE_JSON_LINE_SIZE];
+  char *str = line;
+
+  uint64_t block = 0;
+  for(size_t i = 0; i < sizeof record->block; ++i)
+    block = block << 8 | record->block[i];
+
+  str += sprintf(str, "{\"block\":%llu,\"op\":\"%s\",", (unsigned long long)block, op == encrypt ? "encrypt" : "decrypt");
+  str = trace_put_field(str, "", "m", record->msg, MSG_SINGLE_BLOCK_SIZE);
+  str = trace_put_str(str, ",\"k\":[");
+  for(size_t i = 0; i < KEY_SUBKEYS_NUM; ++i)
+    str = trace_put_hex(trace_put_str(str, i ? "," : ""), record->subkeys[i], KEY_ITER_SIZE);
+
+  str = trace_put_field(str, "],", "ip", record->ip, MSG_IP_SIZE);
+  str = trace_put_field(str, ",", "l0", record->L0, MSG_LR_SIZE);
+  str = trace_put_field(str, ",", "r0", record->R0, MSG_LR_SIZE);
+  str = trace_put_str(str, ",\"rounds\":[");
+  for(size_t i = 0; i < KEY_SUBKEYS_NUM; ++i)
+  {
+    const trace_round_t * const round = &record->rounds[i];
+
+    str = trace_put_field(str, i ? ",{" : "{", "e", round->e, MSG_E_BIT_SIZE);
+    str = trace_put_field(str, ",", "ke", round->ke, MSG_E_BIT_SIZE);
+    str = trace_put_field(str, ",", "b", round->b, MSG_B_INDICES_SIZE);
+    str = trace_put_field(str, ",", "s", round->s, MSG_SBOX_SELECTION_SIZE);
+    str = trace_put_field(str, ",", "p", round->p, MSG_P_PERMUT_SIZE);
+    str = trace_put_field(str, ",", "l", round->L, MSG_LR_SIZE);
+    str = trace_put_field(str, ",", "r", round->R, MSG_LR_SIZE);
+    str = trace_put_str(str, "}");
+  }
+
+  str = trace_put_field(str, "],", "out", record->out, MSG_SINGLE_BLOCK_SIZE);
+  str = trace_put_str(str, "}\n");
+
+  fwrite(line, 1, (size_t)(str - line), g_trace_file);
+}
+
+static void engine_trace(const uint8_t * const msg_blocks, uint8_t *out_blocks, size_t first_block, size_t blocks_num, const key_set_t * const key_set, enum operation op)
+{
+  // traced blocks of this batch are redone with round dumps, the rest is left as the fast engine wrote it
+
+  const size_t last_block = first_block + blocks_num - 1;
+  if(!(g_app_arg.flags & ARG_APP_TRACE) || last_block < g_app_arg.trace_first || first_block > g_app_arg.trace_last)
+    return;
+
+  const size_t from = first_block > g_app_arg.trace_first ? first_block : g_app_arg.trace_first;
+  const size_t to = last_block < g_app_arg.trace_last ? last_block : g_app_arg.trace_last;
+
+  if(g_app_arg.trace_format != trace_text)
+  {
+    trace_record_t record;
+    g_trace_record = &record;
+    for(size_t block = from; block <= to; ++block)
+    {
+      const size_t n = block - first_block;
+      for(size_t i = 0; i < sizeof record.block; ++i)
+        record.block[i] = (uint8_t)((uint64_t)block >> (56 - 8 * i));
+
+      memset(out_blocks + n * MSG_SINGLE_BLOCK_SIZE, 0x00, MSG_SINGLE_BLOCK_SIZE);
+      msg_ede_block(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE, key_set, op, out_blocks + n * MSG_SINGLE_BLOCK_SIZE);
+      trace_write_record(&record, op);
+    }
+    g_trace_record = NULL;
+
+    return;
+  }
+
+  g_trace_active = 1;
+  for(size_t block = from; block <= to; ++block)
+  {
+    const size_t n = block - first_block;
+    des_printf("Block %zu\n", block);
+
+    memset(out_blocks + n * MSG_SINGLE_BLOCK_SIZE, 0x00, MSG_SINGLE_BLOCK_SIZE);
+    msg_ede_block(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE, key_set, op, out_blocks + n * MSG_SINGLE_BLOCK_SIZE);
+    des_printf("\n");
+  }
+  g_trace_active = 0;
+}
+
+static void ctr_partial(const engine_job_t * const job, uint64_t counter, size_t skip, const uint8_t * const msg, size_t size, uint8_t *out)
+{
+  // bytes skip to skip + size of a single keystream block, at either end of an unaligned range
+
+  uint8_t counter_block[MSG_SINGLE_BLOCK_SIZE];
+  uint8_t keystream[MSG_SINGLE_BLOCK_SIZE] = {0};
+  ctr_fill(counter, 1, counter_block);
+
+  if(job->illustrated)
+    msg_ede_block(counter_block, job->key_set, encrypt, keystream);
+  else
+    fast_encrypt_block(job->key_sched, counter_block, keystream);
+
+  for(size_t i = 0; i < size; ++i)
+    out[i] = msg[i] ^ keystream[skip + i];
+}
+
+static void ctr_trace(uint64_t iv, size_t first_block, size_t last_block, const key_set_t * const key_set)
+{
+  // traced keystream blocks are redone from their counters, the output is already final
+
+  if(!(g_app_arg.flags & ARG_APP_TRACE) || last_block < g_app_arg.trace_first || first_block > g_app_arg.trace_last)
+    return;
+
+  const size_t from = first_block > g_app_arg.trace_first ? first_block : g_app_arg.trace_first;
+  const size_t to = last_block < g_app_arg.trace_last ? last_block : g_app_arg.trace_last;
+  for(size_t block = from; block <= to; block += BS_MAX_BLOCKS)
+  {
+    const size_t blocks_num = to - block + 1 < BS_MAX_BLOCKS ? to - block + 1 : BS_MAX_BLOCKS;
+
+    uint8_t counter_blocks[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+    uint8_t keystream[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+    ctr_fill(iv + block, blocks_num, counter_blocks);
+    engine_trace(counter_blocks, keystream, block, blocks_num, key_set, encrypt);
+  }
+}
+
+static void cbc_trace(const uint8_t * const msg_blocks, size_t blocks_num, const key_set_t * const key_set)
+{
+  // traced blocks are redone aside, the output already has the previous ciphertext block XORed in
+
+  uint8_t scratch[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  for(size_t block = 0; block < blocks_num && block <= g_app_arg.trace_last; block += BS_MAX_BLOCKS)
+  {
+    const size_t chunk = blocks_num - block < BS_MAX_BLOCKS ? blocks_num - block : BS_MAX_BLOCKS;
+    engine_trace(msg_blocks + block * MSG_SINGLE_BLOCK_SIZE, scratch, block, chunk, key_set, decrypt);
+  }
+}
+
+/*
+ *
+ *  Interleaved CBC streams. One CBC chain is serial, but independent files
+ *  are not: step t takes block t of every stream that is still going, XORs
+ *  it with its chain and sends all of them through the engine cascade as
+ *  one batch. Streams are sorted by length, so the ones still going are
+ *  always a prefix and each step is a contiguous batch.
+ *
+ */
+
+typedef struct
+{
+  const uint8_t *msg;
+  size_t msg_size;
+  size_t blocks_num;
+  uint8_t *out;
+  uint8_t chain[MSG_SINGLE_BLOCK_SIZE];
+  char output_file[INPUT_FILES_LEN];
+} stream_t;
+
+#define STREAMS_LINE_LEN (3 * INPUT_FILES_LEN)
+#define STREAMS_TILE_BLOCKS 16
+
+static int streams_parse_line(const char * const line, char *data_file, char *output_file, uint8_t *iv)
+{
+  // widths follow the buffer sizes, one longer for the IV so an overlong one is caught below
+
+  char format[32] = {0};
+  sprintf(format, "%%%ds %%%ds %%%ds", INPUT_FILES_LEN - 1, INPUT_FILES_LEN - 1, KEY_HEXSTR_LEN + 1);
+
+  char iv_hex[KEY_HEXSTR_LEN + 2] = {0};
+  if(sscanf(line, format, data_file, output_file, iv_hex) != 3)
+    return 0;
+
+  if(strlen(iv_hex) != KEY_HEXSTR_LEN || !is_valid_hex_str(iv_hex, KEY_HEXSTR_LEN))
+    return 0;
+
+  // the hex conversion ORs into place and the stream sits in uninitialized arena memory
+  memset(iv, 0, MSG_SINGLE_BLOCK_SIZE);
+  hex_str_to_bytes(iv_hex, KEY_HEXSTR_LEN, iv);
+
+  return 1;
+}
+
+static int streams_line_empty(const char * const line)
+{
+  for(const char *chr = line; *chr; ++chr)
+    if(!isspace((unsigned char)*chr))
+      return 0;
+
+  return 1;
+}
+
+static size_t streams_arena_size(const char * const list_file)
+{
+  // data, padded output and bookkeeping of every stream, for the arena sized at startup
+
+  FILE *file = fopen(list_file, "r");
+  if(!file)
+    return 0;
+
+  size_t ret = 0;
+  char line[STREAMS_LINE_LEN];
+  while(fgets(line, sizeof line, file))
+  {
+    char data_file[INPUT_FILES_LEN], output_file[INPUT_FILES_LEN];
+    uint8_t iv[MSG_SINGLE_BLOCK_SIZE];
+    if(!streams_parse_line(line, data_file, output_file, iv))
+      continue;
+
+    const size_t data_size = file_size_of(data_file);
+    ret += arena_round(data_size) + arena_round(data_size + MSG_SINGLE_BLOCK_SIZE) + arena_round(sizeof(stream_t) + sizeof(stream_t*));
+  }
+
+  fclose(file);
+
+  return ret + 2 * ARENA_ALIGN;
+}
+
+static int streams_by_length(const void *a, const void *b)
+{
+  const size_t a_blocks = (*(const stream_t * const *)a)->blocks_num;
+  const size_t b_blocks = (*(const stream_t * const *)b)->blocks_num;
+
+  return a_blocks < b_blocks ? 1 : (a_blocks > b_blocks ? -1 : 0);
+}
+
+static size_t streams_load(arena_t *arena, const char * const list, size_t list_size, stream_t ***ret)
+{
+  size_t lines_num = 0;
+  for(size_t i = 0; i < list_size; ++i)
+    lines_num += list[i] == '\n' || i + 1 == list_size;
+
+  stream_t * const streams = (stream_t*)arena_alloc(arena, lines_num * sizeof(stream_t));
+  stream_t ** const sorted = (stream_t**)arena_alloc(arena, lines_num * sizeof(stream_t*));
+  if(!streams || !sorted)
+    return 0;
+
+  size_t streams_num = 0;
+  for(size_t pos = 0, line_num = 1; pos < list_size; ++line_num)
+  {
+    char line[STREAMS_LINE_LEN] = {0};
+    size_t len = 0;
+    for(; pos < list_size && list[pos] != '\n'; ++pos)
+      if(len < sizeof line - 1)
+        line[len++] = list[pos];
+    ++pos;
+
+    if(streams_line_empty(line))
+      continue;
+
+    stream_t * const stream = &streams[streams_num];
+    char data_file[INPUT_FILES_LEN];
+    if(!streams_parse_line(line, data_file, stream->output_file, stream->chain))
+    {
+      printf("stream list line %zu is required to be '<data file> <output file> <IV hex>'\n", line_num);
+      return 0;
+    }
+
+    char *msg = NULL;
+    stream->msg_size = file_read_all(data_file, arena, &msg);
+    stream->msg = (const uint8_t*)msg;
+    stream->blocks_num = (stream->msg_size + MSG_SINGLE_BLOCK_SIZE - 1) / MSG_SINGLE_BLOCK_SIZE;
+    stream->out = (uint8_t*)arena_alloc(arena, stream->blocks_num * MSG_SINGLE_BLOCK_SIZE);
+    if(!stream->msg_size || !stream->out)
+    {
+      printf("Empty data file '%s'\n", data_file);
+      return 0;
+    }
+
+    sorted[streams_num] = stream;
+    ++streams_num;
+  }
+
+  qsort(sorted, streams_num, sizeof *sorted, streams_by_length);
+  *ret = sorted;
+
+  return streams_num;
+}
+
+static int streams_crypt(stream_t * const * const streams, size_t streams_num, const engine_job_t * const job_template)
+{
+  /*
+   *
+   *  Streams are far apart in memory, so a group of lanes is staged
+   *  STREAMS_TILE_BLOCKS blocks at a time, block t of every lane next to
+   *  each other. Every stream is then read and written in whole runs and
+   *  each step is one contiguous batch for the engines.
+   *
+   */
+
+  static uint64_t tile_in[STREAMS_TILE_BLOCKS][BS_MAX_BLOCKS];
+  static uint64_t tile_out[STREAMS_TILE_BLOCKS][BS_MAX_BLOCKS];
+  uint64_t chains[BS_MAX_BLOCKS];
+
+  engine_job_t job = *job_template;
+  job.first_block = 0;
+
+  size_t active = streams_num;
+  for(size_t tile = 0; active; tile += STREAMS_TILE_BLOCKS)
+  {
+    while(active && streams[active - 1]->blocks_num <= tile)
+      --active;
+
+    const size_t pos = tile * MSG_SINGLE_BLOCK_SIZE;
+    for(size_t first = 0; first < active; first += BS_MAX_BLOCKS)
+    {
+      const size_t tile_lanes = active - first < BS_MAX_BLOCKS ? active - first : BS_MAX_BLOCKS;
+      for(size_t l = 0; l < tile_lanes; ++l)
+      {
+        const stream_t * const stream = streams[first + l];
+        memcpy(&chains[l], stream->chain, MSG_SINGLE_BLOCK_SIZE);
+
+        // zero padded past the end of the stream
+        for(size_t t = 0; t < STREAMS_TILE_BLOCKS; ++t)
+        {
+          const size_t block_pos = pos + t * MSG_SINGLE_BLOCK_SIZE;
+          const size_t msg_bytes = block_pos >= stream->msg_size ? 0 : (stream->msg_size - block_pos < MSG_SINGLE_BLOCK_SIZE ? stream->msg_size - block_pos : MSG_SINGLE_BLOCK_SIZE);
+
+          tile_in[t][l] = 0;
+          memcpy(&tile_in[t][l], stream->msg + block_pos, msg_bytes);
+        }
+      }
+
+      size_t lanes = tile_lanes;
+      for(size_t t = 0; t < STREAMS_TILE_BLOCKS; ++t)
+      {
+        // lanes still going are a prefix of the group too
+        while(lanes && streams[first + lanes - 1]->blocks_num <= tile + t)
+          --lanes;
+
+        if(!lanes)
+          break;
+
+        // chained on the previous ciphertext when encrypting, after the engine when decrypting
+        if(job.op == encrypt)
+        {
+          for(size_t l = 0; l < lanes; ++l)
+            tile_in[t][l] ^= chains[l];
+        }
+
+        job.msg_blocks = (const uint8_t*)tile_in[t];
+        job.out_blocks = (uint8_t*)tile_out[t];
+        job.last_block = lanes;
+        engine_job_run(&job);
+        if(!job.ok)
+        {
+          engine_verify_report(job.mismatch_block, job.mismatch_engine);
+          return 0;
+        }
+
+        if(job.op == encrypt)
+        {
+          memcpy(chains, tile_out[t], lanes * MSG_SINGLE_BLOCK_SIZE);
+        }
+        else
+        {
+          for(size_t l = 0; l < lanes; ++l)
+            tile_out[t][l] ^= chains[l];
+
+          memcpy(chains, tile_in[t], lanes * MSG_SINGLE_BLOCK_SIZE);
+        }
+      }
+
+      for(size_t l = 0; l < tile_lanes; ++l)
+      {
+        stream_t * const stream = streams[first + l];
+        memcpy(stream->chain, &chains[l], MSG_SINGLE_BLOCK_SIZE);
+
+        const size_t blocks_num = stream->blocks_num - tile < STREAMS_TILE_BLOCKS ? stream->blocks_num - tile : STREAMS_TILE_BLOCKS;
+        for(size_t t = 0; t < blocks_num; ++t)
+          memcpy(stream->out + pos + t * MSG_SINGLE_BLOCK_SIZE, &tile_out[t][l], MSG_SINGLE_BLOCK_SIZE);
+      }
+    }
+  }
+
+  return 1;
+}
+
+static int streams_write(stream_t * const * const streams, size_t streams_num)
+{
+  for(size_t s = 0; s < streams_num; ++s)
+  {
+    FILE *file = fopen(streams[s]->output_file, "wb");
+    if(!file)
+    {
+      printf("Can't open result file '%s'", streams[s]->output_file);
+      return 0;
+    }
+
+    setvbuf(file, NULL, _IONBF, 0);
+    const unsigned long result_file_written = fwrite(streams[s]->out, 1, streams[s]->blocks_num * MSG_SINGLE_BLOCK_SIZE, file);
+    des_printf("Written %lu bytes to %s\n", result_file_written, streams[s]->output_file);
+    fclose(file);
+  }
+
+  return 1;
+}
+
+/*
+ *
+ *  Output and cipher feedback. Every keystream block is the encryption of
+ *  the one before it: in OFB the previous keystream block, in CFB the
+ *  previous ciphertext, a whole block back for cfb and a byte back for
+ *  cfb8. There is no padding, the output is as long as the input.
+ *
+ *  The OFB keystream depends on nothing but the key and the IV, so a helper
+ *  thread computes it ahead of the data in chunks and the data path only
+ *  XORs each chunk in and writes it out as soon as it is published. Both
+ *  chains are serial and go through the lowest latency single block path,
+ *  the table engine on a block kept in a register.
+ *
+ */
+
+#define OFB_CHUNK_BLOCKS (1 << 12)
+
+typedef struct
+{
+  const fast_key_sched_t *key_sched;
+  const key_set_t *key_set;
+  int illustrated;
+  size_t verify_sample;
+  const uint8_t *iv;
+
+  uint8_t *keystream;
+  size_t blocks_num;
+
+  // keystream blocks done so far and whether they are good, guarded by lock
+  pthread_mutex_t lock;
+  pthread_cond_t published;
+  size_t ready;
+  int ok;
+
+  // set by the keystream thread before it publishes a failure
+  size_t mismatch_block;
+} ofb_keystream_t;
+
+static uint64_t feedback_block(const fast_key_sched_t * const key_sched, const key_set_t * const key_set, int illustrated, uint64_t block)
+{
+  if(!illustrated)
+    return fast_crypt_u64(key_sched, encrypt, block);
+
+  uint8_t in[MSG_SINGLE_BLOCK_SIZE];
+  uint8_t out[MSG_SINGLE_BLOCK_SIZE] = {0};
+  fast_store_block(block, in);
+  msg_ede_block(in, key_set, encrypt, out);
+
+  return fast_load_block(out);
+}
+
+static int feedback_verify(uint64_t block, uint64_t keystream, size_t unit, const key_set_t * const key_set, size_t sample, size_t *mismatch_block)
+{
+  if(!sample || unit % sample)
+    return 1;
+
+  uint8_t in[MSG_SINGLE_BLOCK_SIZE];
+  uint8_t out[MSG_SINGLE_BLOCK_SIZE];
+  fast_store_block(block, in);
+  fast_store_block(keystream, out);
+
+  return engine_verify(in, out, unit, 1, key_set, encrypt, sample, mismatch_block);
+}
+
+static void ofb_publish(ofb_keystream_t *ofb, size_t ready, int ok)
+{
+  pthread_mutex_lock(&ofb->lock);
+  ofb->ready = ready;
+  ofb->ok = ok;
+  pthread_cond_signal(&ofb->published);
+  pthread_mutex_unlock(&ofb->lock);
+}
+
+static void *ofb_keystream_run(void *arg)
+{
+  ofb_keystream_t * const ofb = (ofb_keystream_t*)arg;
+
+  uint64_t block = fast_load_block(ofb->iv);
+  for(size_t n = 0; n < ofb->blocks_num;)
+  {
+    const size_t chunk_end = ofb->blocks_num - n < OFB_CHUNK_BLOCKS ? ofb->blocks_num : n + OFB_CHUNK_BLOCKS;
+    for(; n < chunk_end; ++n)
+    {
+      const uint64_t keystream = feedback_block(ofb->key_sched, ofb->key_set, ofb->illustrated, block);
+      if(!feedback_verify(block, keystream, n, ofb->key_set, ofb->verify_sample, &ofb->mismatch_block))
+      {
+        // wakes the data path up for good
+        ofb_publish(ofb, ofb->blocks_num, 0);
+        return NULL;
+      }
+
+      fast_store_block(keystream, ofb->keystream + n * MSG_SINGLE_BLOCK_SIZE);
+      block = keystream;
+    }
+
+    ofb_publish(ofb, n, 1);
+  }
+
+  return NULL;
+}
+
+static int ofb_crypt(ofb_keystream_t *ofb, uint8_t *msg, size_t size, FILE *result_file)
+{
+  // msg is XORed in place, the illustrated engine prints as it goes so its keystream is done up front instead
+
+  pthread_mutex_init(&ofb->lock, NULL);
+  pthread_cond_init(&ofb->published, NULL);
+  ofb->ready = 0;
+  ofb->ok = 1;
+
+  pthread_t thread;
+  const int started = !ofb->illustrated && pthread_create(&thread, NULL, ofb_keystream_run, ofb) == 0;
+  if(!started)
+    ofb_keystream_run(ofb);
+
+  int ok = 1;
+  unsigned long result_file_written = 0;
+  for(size_t pos = 0; pos < size;)
+  {
+    pthread_mutex_lock(&ofb->lock);
+    while(ofb->ready * MSG_SINGLE_BLOCK_SIZE <= pos)
+      pthread_cond_wait(&ofb->published, &ofb->lock);
+
+    const size_t end = ofb->ready * MSG_SINGLE_BLOCK_SIZE < size ? ofb->ready * MSG_SINGLE_BLOCK_SIZE : size;
+    ok = ofb->ok;
+    pthread_mutex_unlock(&ofb->lock);
+
+    if(!ok)
+      break;
+
+    for(size_t i = pos; i < end; ++i)
+      msg[i] ^= ofb->keystream[i];
+
+    if(result_file)
+      result_file_written += fwrite(msg + pos, 1, end - pos, result_file);
+
+    pos = end;
+  }
+
+  if(started)
+    pthread_join(thread, NULL);
+
+  pthread_cond_destroy(&ofb->published);
+  pthread_mutex_destroy(&ofb->lock);
+
+  if(!ok)
+    engine_verify_report(ofb->mismatch_block, "table");
+
+  if(result_file)
+    des_printf("Written %lu bytes to %s\n", result_file_written, g_app_arg.output_file);
+
+  return ok;
+}
+
+static int cfb_crypt(const engine_job_t * const job, enum operation op, const uint8_t * const msg, size_t size, size_t step, uint8_t *out)
+{
+  // the ciphertext is shifted into the register step bytes at a time, 8 for cfb and 1 for cfb8
+
+  uint64_t block = fast_load_block(job->iv);
+  for(size_t pos = 0; pos < size; pos += step)
+  {
+    const size_t bytes = size - pos < step ? size - pos : step;
+    const uint64_t keystream = feedback_block(job->key_sched, job->key_set, job->illustrated, block);
+    size_t mismatch_block = 0;
+    if(!feedback_verify(block, keystream, job->block_base + pos / step, job->key_set, job->verify_sample, &mismatch_block))
+    {
+      engine_verify_report(mismatch_block, "table");
+      return 0;
+    }
+
+    for(size_t i = 0; i < bytes; ++i)
+      out[pos + i] = msg[pos + i] ^ (uint8_t)(keystream >> (56 - 8 * i));
+
+    const uint8_t * const cipher = op == encrypt ? out + pos : msg + pos;
+    for(size_t i = 0; i < bytes; ++i)
+      block = block << 8 | cipher[i];
+  }
+
+  return 1;
+}
+
+static void feedback_trace(const uint8_t * const iv, const uint8_t * const feed, size_t step, size_t units_num, const key_set_t * const key_set)
+{
+  // block encrypted for unit u is the 8 bytes at u * step of the IV followed by feed, redone aside as in cbc
+
+  if(!(g_app_arg.flags & ARG_APP_TRACE))
+    return;
+
+  uint8_t in_blocks[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  uint8_t scratch[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  for(size_t unit = g_app_arg.trace_first; unit < units_num && unit <= g_app_arg.trace_last; unit += BS_MAX_BLOCKS)
+  {
+    const size_t chunk = units_num - unit < BS_MAX_BLOCKS ? units_num - unit : BS_MAX_BLOCKS;
+    for(size_t n = 0; n < chunk; ++n)
+    {
+      for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+      {
+        const size_t pos = (unit + n) * step + i;
+        in_blocks[n * MSG_SINGLE_BLOCK_SIZE + i] = pos < MSG_SINGLE_BLOCK_SIZE ? iv[pos] : feed[pos - MSG_SINGLE_BLOCK_SIZE];
+      }
+    }
+
+    engine_trace(in_blocks, scratch, unit, chunk, key_set, encrypt);
+  }
+}
+
+#define ENGINE_BENCH_CLOCKS (CLOCKS_PER_SEC / 4)
+
+static void perm_bench(const uint8_t * const msg_blocks, size_t blocks_num)
+{
+  // IP and IP^-1 of every block, through tables compiled from g_ip_table and g_ip_reverse_table and through the delta swaps
+
+  static perm_t ip_tables[2];
+  perm_compile(g_ip_table, 64, 64, &ip_tables[0]);
+  perm_compile(g_ip_reverse_table, 64, 64, &ip_tables[1]);
+
+  for(int swaps = 0; swaps < 2; ++swaps)
+  {
+    uint64_t acc = 0;
+    size_t done = 0;
+    clock_t elapsed = 0;
+    const clock_t start = clock();
+    do
+    {
+      for(size_t n = 0; n < blocks_num; ++n)
+      {
+        const uint64_t block = fast_load_block(msg_blocks + n * MSG_SINGLE_BLOCK_SIZE);
+        acc ^= swaps ? perm_ip_reverse(perm_ip(block)) : perm_apply(&ip_tables[1], perm_apply(&ip_tables[0], block));
+      }
+
+      done += blocks_num;
+      elapsed = clock() - start;
+    } while(elapsed < ENGINE_BENCH_CLOCKS);
+
+    // IP^-1 of IP is the block itself
+    const volatile uint64_t sink = acc;
+    (void)sink;
+
+    printf("%-10s %8.1f ns/block\n", swaps ? "ip swaps" : "ip tables", (double)elapsed * 1e9 / CLOCKS_PER_SEC / (double)done);
+  }
+}
+
+static void engine_bench(const fast_key_sched_t * const key_sched, const bs_key_sched_t * const bs_key_sched_buff, enum operation op, const uint8_t * const msg_blocks, size_t blocks_num)
+{
+  // every engine goes over the whole blocks of the data file repeatedly for at least ENGINE_BENCH_CLOCKS
+
+  uint8_t out_blocks[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+  for(size_t i = 0; i < sizeof g_engines / sizeof g_engines[0]; ++i)
+  {
+    const engine_t * const engine = &g_engines[i];
+    if(engine->illustrated || !engine->supported())
+      continue;
+
+    const size_t step = engine->batch_blocks ? engine->batch_blocks : 1;
+    if(blocks_num < step)
+    {
+      printf("%-10s needs at least %zu blocks\n", engine->name, step);
+      continue;
+    }
+
+    size_t done = 0;
+    clock_t elapsed = 0;
+    const clock_t start = clock();
+    do
+    {
+      for(size_t it = 0; it + step <= blocks_num; it += step)
+        engine_run_batch(engine, key_sched, bs_key_sched_buff, op, msg_blocks + it * MSG_SINGLE_BLOCK_SIZE, out_blocks);
+
+      done += blocks_num - blocks_num % step;
+      elapsed = clock() - start;
+    } while(elapsed < ENGINE_BENCH_CLOCKS);
+
+    printf("%-10s %8.1f ns/block\n", engine->name, (double)elapsed * 1e9 / CLOCKS_PER_SEC / (double)done);
+  }
+
+  perm_bench(msg_blocks, blocks_num);
+}
+
+int main(int argc, char **argv)
+{
+  int ret = 0;
+
+  g_app_arg = arg_process(argc, argv);
+  if(!arg_valid(g_app_arg))
+  {
+    usage();
+    return 0;
+  }
+
+  const engine_t *engines[ENGINES_MAX] = {0};
+  const size_t engines_num = engine_select(g_app_arg.engine, g_app_arg.flags & ARG_APP_QUIET, engines);
+  if(!engines_num)
+    return 0;
+ 
+  // one arena for the key files, the S-box file, the data file and the result file buffer
+  const size_t data_file_size = file_size_of(g_app_arg.data_file);
+  size_t arena_size = arena_round(ARENA_IO_BUFF_SIZE) + arena_round(data_file_size);
+  if(*g_app_arg.sbox_file)
+    arena_size += arena_round(file_size_of(g_app_arg.sbox_file));
+
+  // the whole output with -j and in every mode but ECB, which also take an IV, or every stream listed in the data file
+  if(g_app_arg.flags & ARG_APP_STREAMS)
+    arena_size += streams_arena_size(g_app_arg.data_file);
+  else if(g_app_arg.jobs > 1 || g_app_arg.mode != mode_ecb)
+    arena_size += arena_round(data_file_size);
+
+  if(g_app_arg.mode != mode_ecb && !(g_app_arg.flags & ARG_APP_STREAMS))
+    arena_size += arena_round(file_size_of(g_app_arg.iv_file));
+  for(size_t k = 0; k < g_app_arg.keys_num; ++k)
+    arena_size += arena_round(file_size_of(g_app_arg.key_files[k]));
+
+  arena_t arena;
+  if(!arena_init(&arena, arena_size + ARENA_ALIGN))
+  {
+    printf("Can't allocate %zu bytes of working memory\n", arena_size);
+    return 1;
+  }
+
+  // every engine table is built from g_sboxes later on, so they are swapped first
+  if(*g_app_arg.sbox_file)
+  {
+    char *sbox_file_buffer = NULL;
+    const unsigned long sbox_file_size = file_read_all(g_app_arg.sbox_file, &arena, &sbox_file_buffer);
+    if(!sbox_file_size || !msg_sbox_load(sbox_file_buffer, sbox_file_size))
+    {
+      printf("%s is required to hold 8 * 64 decimal S-box entries from 0 to 15\n", g_app_arg.sbox_file);
+      goto key_end;
+    }
+  }
+
+  char *key_file_buffer = NULL;
+  uint8_t key_bytes[KEY_EDE_NUM][KEY_SIZE] = {{0}};
+  key_set_t key_set;
+  memset(&key_set, 0x00, sizeof key_set);
+  key_set.num = g_app_arg.keys_num;
+  int desx = 0;
+
+  for(size_t k = 0; k < key_set.num; ++k)
+  {
+    const char * const key_file = g_app_arg.key_files[k];
+    const unsigned long key_file_size = file_read_all(key_file, &arena, &key_file_buffer);
+    if(!key_file_size || !key_file_buffer)
+    {
+      printf("Error reading key '%s' file size '%lu'\n", key_file, key_file_size);
+      goto key_end;
+    }
+
+    // ------------------------------  + 1 cause line feed, DESX whitening keys K1 and K2 on two more lines
+    const unsigned long key_lines = key_file_size / (KEY_HEXSTR_LEN + 1);
+    if(key_file_size % (KEY_HEXSTR_LEN + 1) != 0 || (key_lines != 1 && key_lines != KEY_DESX_LINES))
+    {
+      printf("key file size is required to be hex string consisting 16 character, or three such lines for DESX\n");
+      goto key_end;
+    }
+
+    if(key_lines == KEY_DESX_LINES && key_set.num > 1)
+    {
+      printf("%s holds DESX whitening keys, DESX takes a single key file\n", key_file);
+      goto key_end;
+    }
+
+    for(unsigned long line = 0; line < key_lines; ++line)
+    {
+      if(!is_valid_hex_str(key_file_buffer + line * (KEY_HEXSTR_LEN + 1), KEY_HEXSTR_LEN))
+      {
+        printf("%s does not contain valid hex str\n", key_file);
+        goto key_end;
+      }
+    }
+
+    hex_str_to_bytes(key_file_buffer, KEY_HEXSTR_LEN, key_bytes[k]);
+    if(key_lines == KEY_DESX_LINES)
+    {
+      desx = 1;
+      hex_str_to_bytes(key_file_buffer + (KEY_HEXSTR_LEN + 1), KEY_HEXSTR_LEN, key_set.whiten[encrypt][0]);
+      hex_str_to_bytes(key_file_buffer + 2 * (KEY_HEXSTR_LEN + 1), KEY_HEXSTR_LEN, key_set.whiten[encrypt][1]);
+      memcpy(key_set.whiten[decrypt][0], key_set.whiten[encrypt][1], KEY_SIZE);
+      memcpy(key_set.whiten[decrypt][1], key_set.whiten[encrypt][0], KEY_SIZE);
+    }
+
+    uint8_t key_pc1_bytes[KEY_PC1_SIZE] = {0};
+    key_pc1(key_bytes[k], key_pc1_bytes);
+
+    key_set.rots[k] = key_rotation(key_pc1_bytes);
+
+#ifdef LOG_KEY_DETAILS
+    g_trace_active = g_app_arg.flags & ARG_APP_TRACE && g_app_arg.trace_format == trace_text;
+    if(key_set.num > 1)
+      des_printf("Key %zu\n", k + 1);
+
+    print_as_hexstr_with_title("K = ", key_bytes[k], KEY_SIZE);
+    print_bin_8bit("K = ", key_bytes[k], KEY_SIZE);
+    print_bin_bits("K PC1 = ", key_pc1_bytes, KEY_PC1_SIZE, 7);
+    if(desx)
+    {
+      print_as_hexstr_with_title("K1 (DESX input whitening) = ", key_set.whiten[encrypt][0], KEY_SIZE);
+      print_as_hexstr_with_title("K2 (DESX output whitening) = ", key_set.whiten[encrypt][1], KEY_SIZE);
+    }
+
+    key_rotation_print(&key_set.rots[k]);
+    des_printf("\n");
+    g_trace_active = 0;
+    trace_flush();
+#endif
+  }
+  
+  uint8_t iv_bytes[MSG_SINGLE_BLOCK_SIZE] = {0};
+  if(g_app_arg.mode != mode_ecb && !(g_app_arg.flags & ARG_APP_STREAMS))
+  {
+    char *iv_file_buffer = NULL;
+    const unsigned long iv_file_size = file_read_all(g_app_arg.iv_file, &arena, &iv_file_buffer);
+    if(iv_file_size != KEY_HEXSTR_LEN + 1 || !is_valid_hex_str(iv_file_buffer, KEY_HEXSTR_LEN))
+    {
+      printf("IV file '%s' is required to be hex string consisting 16 character\n", g_app_arg.iv_file);
+      goto key_end;
+    }
+
+    hex_str_to_bytes(iv_file_buffer, KEY_HEXSTR_LEN, iv_bytes);
+  }
+
+  uint8_t *msg_file_buffer = NULL;
+  const unsigned long msg_file_size = file_read_all(g_app_arg.data_file, &arena, (char**)&msg_file_buffer);
+  if(!msg_file_size)
+  {
+    printf("Empty data file '%s'", g_app_arg.data_file);
+    goto key_end;
+  }  
+
+  // result file handling
+  FILE *result_file = NULL;
+  if(*g_app_arg.output_file)
+  {
+    result_file = fopen(g_app_arg.output_file, "wb");
+    if(!result_file)
+      printf("Can't open result file '%s'", g_app_arg.output_file);
+    else
+      setvbuf(result_file, (char*)arena_alloc(&arena, ARENA_IO_BUFF_SIZE), _IOFBF, ARENA_IO_BUFF_SIZE);
+  }
+
+  // structured trace records go through a fully buffered sink
+  static char trace_file_buff[1 << 20];
+  if(g_app_arg.trace_format != trace_text)
+  {
+    g_trace_file = *g_app_arg.trace_file ? fopen(g_app_arg.trace_file, "wb") : stdout;
+    if(!g_trace_file)
+    {
+      printf("Can't open trace file '%s'", g_app_arg.trace_file);
+      goto result_end;
+    }
+
+    setvbuf(g_trace_file, trace_file_buff, _IOFBF, sizeof trace_file_buff);
+    if(g_app_arg.trace_format == trace_binary)
+    {
+      const uint32_t record_size = (uint32_t)TRACE_RECORD_SIZE;
+
+      uint8_t header[TRACE_HEADER_SIZE] = {0};
+      memcpy(header, TRACE_MAGIC, sizeof TRACE_MAGIC - 1);
+      header[8] = TRACE_VERSION;
+      header[9] = (uint8_t)g_app_arg.op;
+      for(size_t i = 0; i < 4; ++i)
+        header[12 + i] = (uint8_t)(record_size >> (24 - 8 * i));
+
+      fwrite(header, 1, TRACE_HEADER_SIZE, g_trace_file);
+    }
+  }
+
+  fast_init();
+  bs_init();
+#ifdef DES_X86
+  if(bs_avx512_supported())
+    bs_init_avx512();
+#endif
+  fast_key_sched_t key_sched = fast_key_sched_ede((const uint8_t (*)[KEY_SIZE])key_bytes, key_set.num);
+  if(desx)
+    fast_key_whiten(&key_sched, key_set.whiten[encrypt][0], key_set.whiten[encrypt][1]);
+
+  const bs_key_sched_t bs_key_sched_buff = bs_key_sched(&key_sched);
+  const fast_block_fn fast_block = g_app_arg.op == encrypt ? fast_encrypt_block : fast_decrypt_block;
+
+  // sampling the reference engine against itself proves nothing
+  const size_t verify_sample = engines[0]->illustrated ? 0 : g_app_arg.verify_sample;
+
+  if(g_app_arg.flags & ARG_APP_BENCH)
+  {
+    engine_bench(&key_sched, &bs_key_sched_buff, g_app_arg.op, msg_file_buffer, msg_file_size / MSG_SINGLE_BLOCK_SIZE);
+    goto result_end;
+  }
+
+  const size_t data_iterations = (size_t)(ceil((double)msg_file_size / MSG_SINGLE_BLOCK_SIZE));
+  size_t it = 0;
+
+  if(g_app_arg.flags & ARG_APP_STREAMS)
+  {
+    const engine_job_t job =
+    {
+      .engines = engines, .engines_num = engines_num,
+      .key_sched = &key_sched, .bs_key_sched_buff = &bs_key_sched_buff, .key_set = &key_set,
+      .op = g_app_arg.op, .verify_sample = verify_sample, .illustrated = engines[0]->illustrated
+    };
+
+    stream_t **streams = NULL;
+    const size_t streams_num = streams_load(&arena, (const char*)msg_file_buffer, msg_file_size, &streams);
+    if(!streams_num || !streams_crypt(streams, streams_num, &job) || !streams_write(streams, streams_num))
+      ret = 1;
+
+    goto result_end;
+  }
+
+  if(g_app_arg.mode == mode_ctr)
+  {
+    uint8_t * const out = (uint8_t*)arena_alloc(&arena, msg_file_size);
+    const uint64_t iv = fast_load_block(iv_bytes);
+
+    // whole keystream blocks in between a partial one at either end
+    const size_t head = (MSG_SINGLE_BLOCK_SIZE - g_app_arg.offset % MSG_SINGLE_BLOCK_SIZE) % MSG_SINGLE_BLOCK_SIZE;
+    const size_t head_bytes = head < msg_file_size ? head : msg_file_size;
+    const size_t first_block = (g_app_arg.offset + MSG_SINGLE_BLOCK_SIZE - 1) / MSG_SINGLE_BLOCK_SIZE;
+    const size_t blocks_num = (msg_file_size - head_bytes) / MSG_SINGLE_BLOCK_SIZE;
+    const size_t tail_bytes = msg_file_size - head_bytes - blocks_num * MSG_SINGLE_BLOCK_SIZE;
+
+    const engine_job_t job =
+    {
+      .engines = engines, .engines_num = engines_num,
+      .key_sched = &key_sched, .bs_key_sched_buff = &bs_key_sched_buff, .key_set = &key_set,
+      .op = encrypt, .verify_sample = verify_sample, .illustrated = engines[0]->illustrated,
+      .mode = mode_ctr, .counter = iv + first_block, .block_base = first_block,
+      .msg_blocks = msg_file_buffer + head_bytes, .out_blocks = out ? out + head_bytes : NULL
+    };
+
+    if(!out)
+      goto result_end;
+
+    if(head_bytes)
+      ctr_partial(&job, iv + first_block - 1, MSG_SINGLE_BLOCK_SIZE - head, msg_file_buffer, head_bytes, out);
+
+    if(blocks_num && !engine_run_jobs(job, engines[0]->illustrated ? 1 : g_app_arg.jobs, blocks_num))
+    {
+      ret = 1;
+      goto result_end;
+    }
+
+    if(tail_bytes)
+      ctr_partial(&job, iv + first_block + blocks_num, 0, msg_file_buffer + msg_file_size - tail_bytes, tail_bytes, out + msg_file_size - tail_bytes);
+
+    ctr_trace(iv, g_app_arg.offset / MSG_SINGLE_BLOCK_SIZE, (g_app_arg.offset + msg_file_size - 1) / MSG_SINGLE_BLOCK_SIZE, &key_set);
+    if(result_file)
+    {
+      const unsigned long result_file_written = fwrite(out, 1, msg_file_size, result_file);
+      des_printf("Written %lu bytes to %s\n", result_file_written, g_app_arg.output_file);
+    }
+
+    goto result_end;
+  }
+
+  if(g_app_arg.mode == mode_ofb)
+  {
+    ofb_keystream_t ofb =
+    {
+      .key_sched = &key_sched, .key_set = &key_set, .illustrated = engines[0]->illustrated,
+      .verify_sample = verify_sample, .iv = iv_bytes,
+      .keystream = (uint8_t*)arena_alloc(&arena, data_iterations * MSG_SINGLE_BLOCK_SIZE), .blocks_num = data_iterations
+    };
+
+    if(!ofb.keystream || !ofb_crypt(&ofb, msg_file_buffer, msg_file_size, result_file))
+    {
+      ret = 1;
+      goto result_end;
+    }
+
+    feedback_trace(iv_bytes, ofb.keystream, MSG_SINGLE_BLOCK_SIZE, data_iterations, &key_set);
+    goto result_end;
+  }
+
+  if(g_app_arg.mode == mode_cfb || g_app_arg.mode == mode_cfb8)
+  {
+    uint8_t * const out = (uint8_t*)arena_alloc(&arena, msg_file_size);
+    const size_t step = g_app_arg.mode == mode_cfb ? MSG_SINGLE_BLOCK_SIZE : 1;
+
+    engine_job_t job =
+    {
+      .engines = engines, .engines_num = engines_num,
+      .key_sched = &key_sched, .bs_key_sched_buff = &bs_key_sched_buff, .key_set = &key_set,
+      .op = encrypt, .verify_sample = verify_sample, .illustrated = engines[0]->illustrated,
+      .mode = mode_cfb, .iv = iv_bytes,
+      .msg_blocks = msg_file_buffer, .out_blocks = out
+    };
+
+    if(!out)
+      goto result_end;
+
+    // cfb decryption only reads ciphertext, whole blocks go through the batch engines and the threads as in ctr
+    size_t done = 0;
+    if(g_app_arg.mode == mode_cfb && g_app_arg.op == decrypt && msg_file_size >= MSG_SINGLE_BLOCK_SIZE)
+    {
+      const size_t blocks_num = msg_file_size / MSG_SINGLE_BLOCK_SIZE;
+      if(!engine_run_jobs(job, engines[0]->illustrated ? 1 : g_app_arg.jobs, blocks_num))
+      {
+        ret = 1;
+        goto result_end;
+      }
+
+      done = blocks_num * MSG_SINGLE_BLOCK_SIZE;
+      job.iv = msg_file_buffer + done - MSG_SINGLE_BLOCK_SIZE;
+      job.block_base = blocks_num;
+    }
+
+    if(!cfb_crypt(&job, g_app_arg.op, msg_file_buffer + done, msg_file_size - done, step, out + done))
+    {
+      ret = 1;
+      goto result_end;
+    }
+
+    feedback_trace(iv_bytes, g_app_arg.op == encrypt ? out : msg_file_buffer, step, (msg_file_size + step - 1) / step, &key_set);
+    if(result_file)
+    {
+      const unsigned long result_file_written = fwrite(out, 1, msg_file_size, result_file);
+      des_printf("Written %lu bytes to %s\n", result_file_written, g_app_arg.output_file);
+    }
+
+    goto result_end;
+  }
+
+  // CBC encryption chains every block on the previous ciphertext, only the serial loop below can do that
+  const int cbc_encrypt = g_app_arg.mode == mode_cbc && g_app_arg.op == encrypt;
+  const int cbc_decrypt = g_app_arg.mode == mode_cbc && g_app_arg.op == decrypt;
+  uint8_t cbc_chain[MSG_SINGLE_BLOCK_SIZE];
+  memcpy(cbc_chain, iv_bytes, MSG_SINGLE_BLOCK_SIZE);
+
+  // the illustrated engine prints as it goes, it stays on a single thread, CBC decryption goes through the jobs anyway
+  if((g_app_arg.jobs > 1 || cbc_decrypt) && !cbc_encrypt && !engines[0]->illustrated)
+  {
+    const size_t blocks_num = msg_file_size / MSG_SINGLE_BLOCK_SIZE;
+    uint8_t * const out_blocks = (uint8_t*)arena_alloc(&arena, blocks_num * MSG_SINGLE_BLOCK_SIZE);
+
+    const engine_job_t job =
+    {
+      .engines = engines, .engines_num = engines_num,
+      .key_sched = &key_sched, .bs_key_sched_buff = &bs_key_sched_buff, .key_set = &key_set,
+      .op = g_app_arg.op, .verify_sample = verify_sample,
+      .mode = g_app_arg.mode, .iv = iv_bytes,
+      .msg_blocks = msg_file_buffer, .out_blocks = out_blocks
+    };
+
+    if(out_blocks && blocks_num)
+    {
+      if(!engine_run_jobs(job, g_app_arg.jobs, blocks_num))
+      {
+        ret = 1;
+        goto result_end;
+      }
+
+      if(cbc_decrypt)
+        cbc_trace(msg_file_buffer, blocks_num, &key_set);
+      else
+        engine_trace(msg_file_buffer, out_blocks, 0, blocks_num, &key_set, g_app_arg.op);
+
+      if(result_file)
+      {
+        const unsigned long result_file_written = fwrite(out_blocks, 1, blocks_num * MSG_SINGLE_BLOCK_SIZE, result_file);
+        des_printf("Written %lu bytes to %s\n", result_file_written, g_app_arg.output_file);
+      }
+
+      it = blocks_num;
+    }
+  }
+
+  // whole groups of blocks go through the batch engines, the tail is done one by one
+  for(size_t e = 0; e < engines_num; ++e)
+  {
+    const engine_t * const engine = engines[e];
+    for(; engine->batch_blocks && !cbc_encrypt && (it + engine->batch_blocks) * MSG_SINGLE_BLOCK_SIZE <= msg_file_size; it += engine->batch_blocks)
+    {
+      uint8_t cipher[BS_MAX_BLOCKS * MSG_SINGLE_BLOCK_SIZE];
+      engine_run_batch(engine, &key_sched, &bs_key_sched_buff, g_app_arg.op, msg_file_buffer + it * MSG_SINGLE_BLOCK_SIZE, cipher);
+      engine_trace(msg_file_buffer + it * MSG_SINGLE_BLOCK_SIZE, cipher, it, engine->batch_blocks, &key_set, g_app_arg.op);
+      size_t mismatch_block = 0;
+      if(verify_sample && !engine_verify(msg_file_buffer + it * MSG_SINGLE_BLOCK_SIZE, cipher, it, engine->batch_blocks, &key_set, g_app_arg.op, verify_sample, &mismatch_block))
+      {
+        engine_verify_report(mismatch_block, engine->name);
+        ret = 1;
+        goto result_end;
+      }
+
+      if(result_file)
+      {
+        const unsigned long result_file_written = fwrite(cipher, 1, engine->batch_blocks * MSG_SINGLE_BLOCK_SIZE, result_file);
+        des_printf("Written %lu bytes to %s\n", result_file_written, g_app_arg.output_file);
+      }
+    }
+  }
+
+  for(; it < data_iterations; ++it)
+  {
+    uint8_t cipher[MSG_SINGLE_BLOCK_SIZE] = {0};
+    uint8_t padded_block[MSG_SINGLE_BLOCK_SIZE];
+    const uint8_t *block = NULL;
+
+    const size_t pos = it * MSG_SINGLE_BLOCK_SIZE;
+    const size_t overlaps = pos + MSG_SINGLE_BLOCK_SIZE;
+    if(overlaps <= msg_file_size)
     {
-      msg_single_block(msg_file_buffer + pos, key_rot, g_app_arg.op, cipher);
+      block = msg_file_buffer + pos;
     }
     else
     {
@@ -1370,15 +4748,48 @@ int main(int argc, char **argv)
      
       const size_t pad_bytes_to_add = overlaps - msg_file_size;
       const size_t remaining_msg_bytes = MSG_SINGLE_BLOCK_SIZE - pad_bytes_to_add;
-      uint8_t padded_block[MSG_SINGLE_BLOCK_SIZE];
       for(size_t i = 0; i < remaining_msg_bytes; ++i)
         padded_block[i] = *(msg_file_buffer + pos + i);
 
       for(size_t i = remaining_msg_bytes; i < (remaining_msg_bytes + pad_bytes_to_add); ++i)
         padded_block[i] = 0x00;
 
+      block = padded_block;
+    }
+
+    uint8_t chained_block[MSG_SINGLE_BLOCK_SIZE];
+    if(cbc_encrypt)
+    {
+      for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+        chained_block[i] = block[i] ^ cbc_chain[i];
+
+      block = chained_block;
+    }
+
+    if(engines[0]->illustrated)
+      msg_ede_block(block, &key_set, g_app_arg.op, cipher);
+    else
+      fast_block(&key_sched, block, cipher);
+
+    engine_trace(block, cipher, it, 1, &key_set, g_app_arg.op);
 
-      msg_single_block(padded_block, key_rot, g_app_arg.op, cipher);
+    size_t mismatch_block = 0;
+    if(verify_sample && !engine_verify(block, cipher, it, 1, &key_set, g_app_arg.op, verify_sample, &mismatch_block))
+    {
+      engine_verify_report(mismatch_block, "table");
+      ret = 1;
+      goto result_end;
+    }
+
+    if(cbc_encrypt)
+    {
+      memcpy(cbc_chain, cipher, MSG_SINGLE_BLOCK_SIZE);
+    }
+    else if(cbc_decrypt)
+    {
+      const uint8_t * const prev = it ? msg_file_buffer + pos - MSG_SINGLE_BLOCK_SIZE : iv_bytes;
+      for(size_t i = 0; i < MSG_SINGLE_BLOCK_SIZE; ++i)
+        cipher[i] ^= prev[i];
     }
 
     if(result_file)
@@ -1388,72 +4799,100 @@ int main(int argc, char **argv)
     }
   } 
 
+result_end:
+  trace_flush();
   if(result_file)
     fclose(result_file);
 
-msg_end:
-  free_key_rot(key_rot);
-  if(msg_file_buffer)
-    free(msg_file_buffer);
+  if(g_trace_file && g_trace_file != stdout)
+    fclose(g_trace_file);
+  else if(g_trace_file)
+    fflush(g_trace_file);
 
 key_end:
-  if(key_file_buffer)
-    free(key_file_buffer);
+  arena_release(&arena);
  
-  return 0;
+  return ret;
+}
+
+static int trace_enabled(void)
+{
+  return !(g_app_arg.flags & ARG_APP_QUIET) || g_trace_active;
+}
+
+static char *trace_reserve(size_t len)
+{
+  if(g_trace_len + len > TRACE_BUFF_SIZE)
+    trace_flush();
+
+  char * const ret = g_trace_buff + g_trace_len;
+  g_trace_len += len;
+
+  return ret;
+}
+
+void trace_flush(void)
+{
+  if(g_trace_len)
+    fwrite(g_trace_buff, 1, g_trace_len, stdout);
+
+  g_trace_len = 0;
 }
 
 int des_printf(const char* restrict format, ...)
 {
-  if(g_app_arg.flags & ARG_APP_QUIET)
+  if(!trace_enabled())
     return 0;
 
   va_list arg;
   va_start(arg, format);
 
-  const int ret = vprintf(format, arg);
-
+  int ret = vsnprintf(g_trace_buff + g_trace_len, TRACE_BUFF_SIZE - g_trace_len, format, arg);
   va_end(arg);
 
+  if(ret >= 0 && (size_t)ret >= TRACE_BUFF_SIZE - g_trace_len)
+  {
+    // didn't fit, retry on an empty buffer or bypass it for an oversized one
+
+    trace_flush();
+
+    va_start(arg, format);
+    if((size_t)ret < TRACE_BUFF_SIZE)
+      ret = vsnprintf(g_trace_buff, TRACE_BUFF_SIZE, format, arg);
+    else
+      ret = vprintf(format, arg);
+    va_end(arg);
+
+    if((size_t)ret >= TRACE_BUFF_SIZE)
+      return ret;
+  }
+
+  if(ret > 0)
+    g_trace_len += (size_t)ret;
+
   return ret;
 }
 
 void print_bin_detail(const uint8_t * const buffer, size_t size, size_t bit_word_len, size_t skip_beg)
 {
-  // this would have been much simpler if I wouldn't need to print various bit word bytes from time to time
+  // bits from skip_beg on, a space after every bit_word_len of them
 
-  const size_t str_len = size * 8 * sizeof(char);
-  char *str = (char*)malloc(str_len);
-  for(size_t i = 0; i < size; ++i)
-  {
-    const uint8_t bt = buffer[i];
-    const size_t idx = i * 8;
+  if(!trace_enabled())
+    return;
 
-    str[idx + 0] = bt & 0x80 ? '1' : '0';
-    str[idx + 1] = bt & 0x40 ? '1' : '0';
-    str[idx + 2] = bt & 0x20 ? '1' : '0';
-    str[idx + 3] = bt & 0x10 ? '1' : '0';
-    str[idx + 4] = bt & 0x08 ? '1' : '0';
-    str[idx + 5] = bt & 0x04 ? '1' : '0';
-    str[idx + 6] = bt & 0x02 ? '1' : '0';
-    str[idx + 7] = bt & 0x01 ? '1' : '0'; 
-  }
+  const size_t bits = size * 8;
+  const size_t printed = bits > skip_beg ? bits - skip_beg : 0;
+  char *str = trace_reserve(printed + (printed ? (printed - 1) / bit_word_len : 0) + 1);
 
-  size_t cnt = 0;
-  for(size_t i = 0; i < str_len; ++i)
+  for(size_t i = skip_beg, cnt = 0; i < bits; ++i, ++cnt)
   {
-    if(i < skip_beg)
-      continue;
-
     if(cnt % bit_word_len == 0 && cnt != 0)
-      des_printf(" ");
-    
-    des_printf("%c", str[i]);
-    ++cnt;
+      *str++ = ' ';
+
+    *str++ = buffer[i / 8] >> (7 - i % 8) & 0x01 ? '1' : '0';
   }
-  
-  free(str);
-  des_printf("\n"); 
+
+  *str = '\n';
 }
 
 void print_bin_with_title(const char *title, const uint8_t * const buffer, size_t size, size_t bit_word_len, size_t skip_beg)
@@ -1479,18 +4918,38 @@ void print_bin_8bit(const char *title, const uint8_t * const buffer, size_t size
 
 void print_buffer(const char * const buffer, unsigned long size)
 {
-  for(unsigned long i = 0; i < size; ++i)
-   des_printf("%c", buffer[i]);
+  if(!trace_enabled())
+    return;
 
-  des_printf("\n"); 
+  if(size >= TRACE_BUFF_SIZE)
+  {
+    trace_flush();
+    fwrite(buffer, 1, size, stdout);
+    des_printf("\n");
+    return;
+  }
+
+  char * const str = trace_reserve(size + 1);
+  memcpy(str, buffer, size);
+  str[size] = '\n';
 }
 
 void print_as_hexstr(const uint8_t * const buffer, size_t size)
 {
+  static const char hex_digits[] = "0123456789abcdef";
+
+  if(!trace_enabled())
+    return;
+
+  char *str = trace_reserve(size * 3 + 1);
   for(size_t i = 0; i < size; ++i)
-    des_printf("%02x ", buffer[i]);
+  {
+    *str++ = hex_digits[buffer[i] >> 4];
+    *str++ = hex_digits[buffer[i] & 0x0f];
+    *str++ = ' ';
+  }
 
-  des_printf("\n");
+  *str = '\n';
 }
 
 void print_as_hexstr_with_title(const char *title, const uint8_t * const buffer, size_t size)
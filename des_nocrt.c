@@ -469,7 +469,7 @@ static void key_pc1(const uint8_t * const buffer, uint8_t *ret)
   ret[0] |= buffer[GET_BYTE_IDX(9)]  >> 6 & 0x02;
  
   ret[0] |= buffer[GET_BYTE_IDX(1)]  >> 7 & 0x01;
-  ret[1] |= buffer[GET_BYTE_IDX(58)] << 2 & 0x80;
+  ret[1] |= buffer[GET_BYTE_IDX(58)] << 1 & 0x80;
   ret[1] |= buffer[GET_BYTE_IDX(50)]      & 0x40;
   ret[1] |= buffer[GET_BYTE_IDX(42)] >> 1 & 0x20;
   ret[1] |= buffer[GET_BYTE_IDX(34)] >> 2 & 0x10;
@@ -478,7 +478,7 @@ static void key_pc1(const uint8_t * const buffer, uint8_t *ret)
 
   ret[1] |= buffer[GET_BYTE_IDX(10)] >> 5 & 0x02;
   ret[1] |= buffer[GET_BYTE_IDX(2)]  >> 6 & 0x01;
-  ret[2] |= buffer[GET_BYTE_IDX(59)] << 1 & 0x80;
+  ret[2] |= buffer[GET_BYTE_IDX(59)] << 2 & 0x80;
   ret[2] |= buffer[GET_BYTE_IDX(51)] << 1 & 0x40;
   ret[2] |= buffer[GET_BYTE_IDX(43)]      & 0x20;
   ret[2] |= buffer[GET_BYTE_IDX(35)] >> 1 & 0x10;
@@ -58,6 +58,710 @@ static unsigned long read_whole_file(const char * const filename, char **ret)
   return actual_size;
 }
 
+/*
+ *
+ *  Bulk file built from known blocks encrypted with the same key, long enough
+ *  to go through every multi block engine and its tail. Period of 7 blocks
+ *  does not divide any engine width, so misplaced blocks don't go unnoticed.
+ *
+ */
+
+#define BULK_BLOCKS 1500
+#define BULK_PERIOD 7
+
+static void bulk_block(size_t idx, const unsigned char (*period_cipher)[8], const unsigned char **plain, const unsigned char **ciph)
+{
+  const size_t pos = idx % BULK_PERIOD;
+  if(pos < 3)
+  {
+    *plain = data[pos + 1];
+    *ciph = cipher[pos + 1];
+  }
+  else
+  {
+    *plain = (const unsigned char*)lewinski.data_not_padded + (pos - 3) * 8;
+    *ciph = lewinski.cipher + (pos - 3) * 8;
+  }
+
+  // same plaintext under other keys
+  if(period_cipher)
+    *ciph = period_cipher[pos];
+}
+
+static int bulk_test_cipher(const char *des_bin_path, const char *key_path, const unsigned char (*period_cipher)[8], const char *extra_args)
+{
+  const char *bulk_data_path = "./tmp_bulk_data.bin";
+  const char *bulk_cipher_path = "./tmp_bulk_cipher.bin";
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+
+  FILE *bulk_data = fopen(bulk_data_path, "wb");
+  FILE *bulk_cipher = fopen(bulk_cipher_path, "wb");
+  if(!bulk_data || !bulk_cipher)
+  {
+    printf("Cant create bulk test files\n");
+    return 0;
+  }
+
+  for(size_t i = 0; i < BULK_BLOCKS; ++i)
+  {
+    const unsigned char *plain = NULL, *ciph = NULL;
+    bulk_block(i, period_cipher, &plain, &ciph);
+    fwrite(plain, 1, 8, bulk_data);
+    fwrite(ciph, 1, 8, bulk_cipher);
+  }
+
+  fclose(bulk_data);
+  fclose(bulk_cipher);
+
+  char cmd[10240] = {0};
+  int ret = 1;
+  for(size_t op = 0; op < 2 && ret; ++op)
+  {
+    sprintf(cmd, "%s %s %s -k %s -o %s -q %s", des_bin_path, op == 0 ? "-e" : "-d", op == 0 ? bulk_data_path : bulk_cipher_path, key_path, tmp_bin_file_path, extra_args);
+    printf("\n\n%s %s \n\n", op == 0 ? "Bulk encrypt" : "Bulk decrypt", cmd);
+
+    system(cmd);
+
+    char *file_content = NULL;
+    const unsigned long bytes_read = read_whole_file(tmp_bin_file_path, &file_content);
+    if(bytes_read != BULK_BLOCKS * 8)
+    {
+      printf("Cant read from %s during BULK test\n", tmp_bin_file_path);
+      free(file_content);
+      ret = 0;
+      break;
+    }
+
+    for(size_t i = 0; i < BULK_BLOCKS; ++i)
+    {
+      const unsigned char *plain = NULL, *ciph = NULL;
+      bulk_block(i, period_cipher, &plain, &ciph);
+
+      if(memcmp(op == 0 ? ciph : plain, file_content + i * 8, 8) != 0)
+      {
+        printf("\n\n!!! BULK %s FAILED !!!\n block %zu %s\n\n", op == 0 ? "ENCRYPTING" : "DECRYPTING", i, extra_args);
+        ret = 0;
+        break;
+      }
+    }
+
+    free(file_content);
+  }
+
+  remove_file(bulk_data_path);
+  remove_file(bulk_cipher_path);
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+static int bulk_test_key(const char *des_bin_path, const char *key_path, const char *extra_args)
+{
+  return bulk_test_cipher(des_bin_path, key_path, NULL, extra_args);
+}
+
+static int bulk_test(const char *des_bin_path, const char *extra_args)
+{
+  return bulk_test_key(des_bin_path, key_filename[1], extra_args);
+}
+
+/*
+ *
+ *  3DES with distinct keys, K1 = 0E329232EA6D0D73, K2 = 133457799BBCDFF1
+ *  and K3 = 0123456789ABCDEF for EDE3, the first two for EDE2. Expected
+ *  blocks of the bulk period from OpenSSL des-ede3 and des-ede, which
+ *  gives the SP 800-67 example ciphertext for its keys.
+ *
+ */
+
+static const unsigned char ede3_cipher[BULK_PERIOD][8] =
+{
+  { 0xdc, 0x39, 0x0b, 0x3f, 0x28, 0xe6, 0x19, 0x4c },
+  { 0xf5, 0xe4, 0xd2, 0x11, 0xb9, 0x23, 0x5c, 0xb1 },
+  { 0x37, 0xc2, 0x81, 0x5e, 0xdb, 0x8c, 0x3f, 0x36 },
+  { 0x47, 0x73, 0x44, 0x2d, 0xee, 0xf1, 0xf3, 0xa8 },
+  { 0xfe, 0x77, 0xac, 0x3e, 0xfd, 0x0a, 0x15, 0x48 },
+  { 0x8c, 0x2f, 0x02, 0x24, 0xa2, 0xdb, 0x54, 0x15 },
+  { 0x37, 0xc2, 0x81, 0x5e, 0xdb, 0x8c, 0x3f, 0x36 }
+};
+
+static const unsigned char ede2_cipher[BULK_PERIOD][8] =
+{
+  { 0x25, 0x39, 0x2e, 0xde, 0xc9, 0x3c, 0x1c, 0xee },
+  { 0x79, 0x3e, 0xcd, 0x59, 0xf8, 0x46, 0x61, 0x5e },
+  { 0xd5, 0xf5, 0x44, 0xcd, 0x4b, 0xa6, 0x06, 0x8c },
+  { 0x7d, 0xd6, 0xf8, 0xef, 0xf5, 0xca, 0x97, 0x4c },
+  { 0xda, 0xcd, 0x33, 0x8e, 0x79, 0x6c, 0x37, 0xba },
+  { 0xfb, 0x29, 0x1b, 0x4a, 0x11, 0xce, 0x2a, 0x70 },
+  { 0xd5, 0xf5, 0x44, 0xcd, 0x4b, 0xa6, 0x06, 0x8c }
+};
+
+static int ede_test(const char *des_bin_path, const char *extra_args)
+{
+  const char *ede_key_path = "./tmp_ede_key.txt";
+  const char *ede_key = "0123456789ABCDEF\n";
+
+  FILE *ede_key_file = fopen(ede_key_path, "wb");
+  if(!ede_key_file)
+  {
+    printf("Cant create EDE key file\n");
+    return 0;
+  }
+
+  fprintf(ede_key_file, "%s", ede_key);
+  fclose(ede_key_file);
+
+  char ede_args[1024] = {0};
+  sprintf(ede_args, "-k %s -k %s %s", key_filename[0], ede_key_path, extra_args);
+  int ret = bulk_test_cipher(des_bin_path, key_filename[1], ede3_cipher, ede_args);
+
+  sprintf(ede_args, "-k %s %s", key_filename[0], extra_args);
+  ret = ret && bulk_test_cipher(des_bin_path, key_filename[1], ede2_cipher, ede_args);
+
+  remove_file(ede_key_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  DESX with K = 0E329232EA6D0D73, K1 = 0123456789ABCDEF whitening the
+ *  input and K2 = FEDCBA9876543210 the output. Expected blocks of the bulk
+ *  period from OpenSSL desx, one block at a time with a zero IV.
+ *
+ */
+
+static const unsigned char desx_cipher[BULK_PERIOD][8] =
+{
+  { 0xb3, 0x0e, 0xea, 0x7e, 0xcc, 0x90, 0x8a, 0x70 },
+  { 0xcd, 0x78, 0xb0, 0x12, 0xc9, 0x64, 0xbb, 0x37 },
+  { 0xc9, 0xb4, 0xe8, 0x7f, 0x2f, 0x2f, 0x08, 0x3f },
+  { 0x92, 0x4a, 0x18, 0x8c, 0xef, 0xa5, 0x3e, 0x1e },
+  { 0xcb, 0x3e, 0xd5, 0x00, 0x52, 0xcc, 0x8f, 0x38 },
+  { 0xd6, 0xd1, 0xa2, 0x42, 0x53, 0x58, 0xfc, 0x53 },
+  { 0xc9, 0xb4, 0xe8, 0x7f, 0x2f, 0x2f, 0x08, 0x3f }
+};
+
+static int desx_test(const char *des_bin_path)
+{
+  // DESX with all zero whitening keys is single DES, with the ones above it has to match OpenSSL
+
+  const char *desx_key_path = "./tmp_desx_key.txt";
+  const char *desx_whiten_path = "./tmp_desx_whiten_key.txt";
+
+  char *key_content = NULL;
+  if(read_whole_file(key_filename[1], &key_content) < 16)
+  {
+    printf("Cant read from %s during DESX test\n", key_filename[1]);
+    free(key_content);
+    return 0;
+  }
+
+  FILE *desx_key = fopen(desx_key_path, "wb");
+  FILE *desx_whiten = fopen(desx_whiten_path, "wb");
+  if(!desx_key || !desx_whiten)
+  {
+    printf("Cant create DESX key file\n");
+    free(key_content);
+    return 0;
+  }
+
+  fprintf(desx_key, "%.16s\n0000000000000000\n0000000000000000\n", key_content);
+  fprintf(desx_whiten, "%.16s\n0123456789ABCDEF\nFEDCBA9876543210\n", key_content);
+  fclose(desx_key);
+  fclose(desx_whiten);
+  free(key_content);
+
+  const char *engines[] = { "", "--engine bs64", "--engine table" };
+  int ret = 1;
+  for(size_t i = 0; ret && i < sizeof engines / sizeof engines[0]; ++i)
+    ret = bulk_test_key(des_bin_path, desx_key_path, engines[i]) && bulk_test_cipher(des_bin_path, desx_whiten_path, desx_cipher, engines[i]);
+
+  remove_file(desx_key_path);
+  remove_file(desx_whiten_path);
+
+  return ret;
+}
+
+static int sbox_test(const char *des_bin_path)
+{
+  // the DES S-boxes from a file change nothing, any other set has to agree with the reference engine
+
+  if(!bulk_test(des_bin_path, "--sbox-file data/sboxes_des.txt"))
+    return 0;
+
+  const char *engines[] = { "table4", "bs64", "table" };
+  for(size_t i = 0; i < sizeof engines / sizeof engines[0]; ++i)
+  {
+    char cmd[10240] = {0};
+    sprintf(cmd, "%s -e %s -k %s -o ./tmp_file.bin -q --engine %s --sbox-file data/sboxes_rotated.txt --verify-sample 1", des_bin_path, lewinski.data_filename, lewinski.key_filename, engines[i]);
+    printf("\n\nCustom S-boxes %s \n\n", cmd);
+
+    if(system(cmd) != 0)
+    {
+      printf("\n\n!!! CUSTOM S-BOX FAILED !!!\n %s\n\n", engines[i]);
+      remove_file("./tmp_file.bin");
+      return 0;
+    }
+  }
+
+  remove_file("./tmp_file.bin");
+
+  return 1;
+}
+
+/*
+ *
+ *  CTR keystream is ECB of the counter blocks, ECB being checked by every
+ *  test above. Whole stream, a slice of it at an unaligned offset and the
+ *  threaded engines all have to give the same bytes, as many as went in.
+ *
+ */
+
+#define CTR_BYTES 1003
+#define CTR_BLOCKS ((CTR_BYTES + 7) / 8)
+
+static int write_file(const char *path, const void *buffer, size_t size)
+{
+  FILE *file = fopen(path, "wb");
+  if(!file)
+    return 0;
+
+  const size_t written = fwrite(buffer, 1, size, file);
+  fclose(file);
+
+  return written == size;
+}
+
+static int ctr_run(const char *des_bin_path, const char *data_path, const char *extra_args, const unsigned char *expected, size_t size)
+{
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+
+  char cmd[10240] = {0};
+  sprintf(cmd, "%s -e %s -k %s -o %s -q --mode ctr --iv ./tmp_ctr_iv.txt %s", des_bin_path, data_path, key_filename[1], tmp_bin_file_path, extra_args);
+  printf("\n\nCTR %s \n\n", cmd);
+  system(cmd);
+
+  char *file_content = NULL;
+  const unsigned long bytes_read = read_whole_file(tmp_bin_file_path, &file_content);
+  const int ret = bytes_read == size && memcmp(file_content, expected, size) == 0;
+  if(!ret)
+    printf("\n\n!!! CTR FAILED !!!\n %s\n\n", extra_args);
+
+  free(file_content);
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+static int ctr_test(const char *des_bin_path)
+{
+  const char *ctr_data_path = "./tmp_ctr_data.bin";
+  const char *ctr_counters_path = "./tmp_ctr_counters.bin";
+  const char *ctr_keystream_path = "./tmp_ctr_keystream.bin";
+  const char *ctr_iv = "FFFFFFFFFFFFFFF0\n"; // wraps around
+
+  unsigned char data[CTR_BYTES], counters[CTR_BLOCKS * 8], expected[CTR_BYTES];
+  for(size_t i = 0; i < CTR_BYTES; ++i)
+    data[i] = (unsigned char)(i * 7 + 3);
+
+  for(size_t n = 0; n < CTR_BLOCKS; ++n)
+  {
+    const unsigned long long counter = 0xFFFFFFFFFFFFFFF0ULL + n;
+    for(size_t i = 0; i < 8; ++i)
+      counters[n * 8 + i] = (unsigned char)(counter >> (56 - 8 * i));
+  }
+
+  int ret = write_file("./tmp_ctr_iv.txt", ctr_iv, strlen(ctr_iv)) && write_file(ctr_data_path, data, CTR_BYTES) && write_file(ctr_counters_path, counters, sizeof counters);
+  if(!ret)
+  {
+    printf("Cant create CTR test files\n");
+    return 0;
+  }
+
+  char cmd[10240] = {0};
+  sprintf(cmd, "%s -e %s -k %s -o %s -q", des_bin_path, ctr_counters_path, key_filename[1], ctr_keystream_path);
+  system(cmd);
+
+  char *keystream = NULL;
+  ret = read_whole_file(ctr_keystream_path, &keystream) == sizeof counters;
+  for(size_t i = 0; ret && i < CTR_BYTES; ++i)
+    expected[i] = data[i] ^ (unsigned char)keystream[i];
+
+  free(keystream);
+
+  ret = ret && ctr_run(des_bin_path, ctr_data_path, "", expected, CTR_BYTES);
+  ret = ret && ctr_run(des_bin_path, ctr_data_path, "-j 3 --engine bs64", expected, CTR_BYTES);
+
+  // bytes 13 to 612 alone
+  ret = ret && write_file(ctr_data_path, data + 13, 600);
+  ret = ret && ctr_run(des_bin_path, ctr_data_path, "--offset 13", expected + 13, 600);
+
+  remove_file("./tmp_ctr_iv.txt");
+  remove_file(ctr_data_path);
+  remove_file(ctr_counters_path);
+  remove_file(ctr_keystream_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  CBC, the first ciphertext block has to be ECB of the first plaintext
+ *  block XOR IV, and every decrypting engine has to give back the zero
+ *  padded plaintext of what the serial encryption chained.
+ *
+ */
+
+static int cbc_test(const char *des_bin_path)
+{
+  const char *cbc_data_path = "./tmp_cbc_data.bin";
+  const char *cbc_cipher_path = "./tmp_cbc_cipher.bin";
+  const char *cbc_first_path = "./tmp_cbc_first.bin";
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+  const char *cbc_iv = "0123456789ABCDEF\n";
+  const unsigned char iv[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+
+  unsigned char data[CTR_BLOCKS * 8] = {0}, first[8];
+  for(size_t i = 0; i < CTR_BYTES; ++i)
+    data[i] = (unsigned char)(i * 5 + 1);
+
+  for(size_t i = 0; i < 8; ++i)
+    first[i] = data[i] ^ iv[i];
+
+  int ret = write_file("./tmp_cbc_iv.txt", cbc_iv, strlen(cbc_iv)) && write_file(cbc_data_path, data, CTR_BYTES) && write_file(cbc_first_path, first, 8);
+  if(!ret)
+  {
+    printf("Cant create CBC test files\n");
+    return 0;
+  }
+
+  char cmd[10240] = {0};
+  sprintf(cmd, "%s -e %s -k %s -o %s -q --mode cbc --iv ./tmp_cbc_iv.txt", des_bin_path, cbc_data_path, key_filename[1], cbc_cipher_path);
+  printf("\n\nCBC %s \n\n", cmd);
+  system(cmd);
+
+  sprintf(cmd, "%s -e %s -k %s -o %s -q", des_bin_path, cbc_first_path, key_filename[1], tmp_bin_file_path);
+  system(cmd);
+
+  char *cipher_content = NULL, *first_content = NULL;
+  ret = read_whole_file(cbc_cipher_path, &cipher_content) == sizeof data && read_whole_file(tmp_bin_file_path, &first_content) == 8 && memcmp(cipher_content, first_content, 8) == 0;
+  free(cipher_content);
+  free(first_content);
+
+  const char *engines[] = { "", "-j 3 --engine bs64", "--engine table4 --verify-sample 3", "--engine reference" };
+  for(size_t i = 0; ret && i < sizeof engines / sizeof engines[0]; ++i)
+  {
+    sprintf(cmd, "%s -d %s -k %s -o %s -q --mode cbc --iv ./tmp_cbc_iv.txt %s", des_bin_path, cbc_cipher_path, key_filename[1], tmp_bin_file_path, engines[i]);
+    printf("\n\nCBC %s \n\n", cmd);
+    system(cmd);
+
+    char *file_content = NULL;
+    ret = read_whole_file(tmp_bin_file_path, &file_content) == sizeof data && memcmp(file_content, data, sizeof data) == 0;
+    free(file_content);
+  }
+
+  if(!ret)
+    printf("\n\n!!! CBC FAILED !!!\n\n");
+
+  remove_file("./tmp_cbc_iv.txt");
+  remove_file(cbc_data_path);
+  remove_file(cbc_cipher_path);
+  remove_file(cbc_first_path);
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  OFB and CFB, the keystream block of either is ECB of the IV followed by
+ *  the output one block back, the keystream itself in OFB and the
+ *  ciphertext in CFB. Every mode then has to decrypt back through every
+ *  engine, cfb8 included.
+ *
+ */
+
+static int feedback_run(const char *des_bin_path, const char *op, const char *mode, const char *data_path, const char *out_path, const char *extra_args)
+{
+  char cmd[10240] = {0};
+  sprintf(cmd, "%s %s %s -k %s -o %s -q --mode %s --iv ./tmp_fb_iv.txt %s", des_bin_path, op, data_path, key_filename[1], out_path, mode, extra_args);
+  printf("\n\nFeedback %s \n\n", cmd);
+
+  return system(cmd) == 0;
+}
+
+static int feedback_test(const char *des_bin_path)
+{
+  const char *fb_data_path = "./tmp_fb_data.bin";
+  const char *fb_out_path = "./tmp_fb_out.bin";
+  const char *fb_prev_path = "./tmp_fb_prev.bin";
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+  const char *fb_iv = "0123456789ABCDEF\n";
+  const unsigned char iv[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+  const unsigned char zeros[CTR_BYTES] = {0};
+
+  unsigned char data[CTR_BYTES], prev[CTR_BLOCKS * 8] = {0};
+  for(size_t i = 0; i < CTR_BYTES; ++i)
+    data[i] = (unsigned char)(i * 11 + 5);
+
+  int ret = write_file("./tmp_fb_iv.txt", fb_iv, strlen(fb_iv));
+  if(!ret)
+  {
+    printf("Cant create feedback test files\n");
+    return 0;
+  }
+
+  // OFB of zeros is the bare keystream, CFB is XORed with data
+  const char *modes[] = { "ofb", "cfb" };
+  for(size_t m = 0; ret && m < sizeof modes / sizeof modes[0]; ++m)
+  {
+    const unsigned char * const plain = m ? data : zeros;
+    ret = write_file(fb_data_path, plain, CTR_BYTES) && feedback_run(des_bin_path, "-e", modes[m], fb_data_path, fb_out_path, "");
+
+    char *out_content = NULL, *ecb_content = NULL;
+    ret = ret && read_whole_file(fb_out_path, &out_content) == CTR_BYTES;
+
+    memcpy(prev, iv, 8);
+    if(ret)
+      memcpy(prev + 8, out_content, (CTR_BLOCKS - 1) * 8);
+
+    char cmd[10240] = {0};
+    sprintf(cmd, "%s -e %s -k %s -o %s -q", des_bin_path, fb_prev_path, key_filename[1], tmp_bin_file_path);
+    ret = ret && write_file(fb_prev_path, prev, sizeof prev) && system(cmd) == 0;
+    ret = ret && read_whole_file(tmp_bin_file_path, &ecb_content) == sizeof prev;
+    for(size_t i = 0; ret && i < CTR_BYTES; ++i)
+      ret = (unsigned char)out_content[i] == (plain[i] ^ (unsigned char)ecb_content[i]);
+
+    free(out_content);
+    free(ecb_content);
+  }
+
+  const char *all_modes[] = { "ofb", "cfb", "cfb8" };
+  const char *engines[] = { "", "-j 3 --engine bs64", "--engine table4 --verify-sample 3", "--engine reference" };
+  ret = ret && write_file(fb_data_path, data, CTR_BYTES);
+  for(size_t m = 0; ret && m < sizeof all_modes / sizeof all_modes[0]; ++m)
+  {
+    ret = feedback_run(des_bin_path, "-e", all_modes[m], fb_data_path, fb_out_path, "");
+    for(size_t i = 0; ret && i < sizeof engines / sizeof engines[0]; ++i)
+    {
+      ret = feedback_run(des_bin_path, "-d", all_modes[m], fb_out_path, tmp_bin_file_path, engines[i]);
+
+      char *file_content = NULL;
+      ret = ret && read_whole_file(tmp_bin_file_path, &file_content) == CTR_BYTES && memcmp(file_content, data, CTR_BYTES) == 0;
+      free(file_content);
+    }
+  }
+
+  if(!ret)
+    printf("\n\n!!! FEEDBACK FAILED !!!\n\n");
+
+  remove_file("./tmp_fb_iv.txt");
+  remove_file(fb_data_path);
+  remove_file(fb_out_path);
+  remove_file(fb_prev_path);
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  Interleaved CBC streams of different lengths have to give what every
+ *  stream gives alone, and decrypt back through the streams too.
+ *
+ */
+
+#define STREAMS_NUM 3
+
+static int streams_test(const char *des_bin_path)
+{
+  const size_t sizes[STREAMS_NUM] = { 1003, 13, 1 };
+  const char *ivs[STREAMS_NUM] = { "0123456789ABCDEF", "FEDCBA9876543210", "0000000000000000" };
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+
+  unsigned char data[CTR_BLOCKS * 8] = {0};
+  for(size_t i = 0; i < CTR_BYTES; ++i)
+    data[i] = (unsigned char)(i * 3 + 2);
+
+  FILE *list = fopen("./tmp_streams.txt", "wb");
+  FILE *cipher_list = fopen("./tmp_streams_cipher.txt", "wb");
+  if(!list || !cipher_list)
+  {
+    printf("Cant create stream lists\n");
+    return 0;
+  }
+
+  int ret = 1;
+  for(size_t i = 0; i < STREAMS_NUM; ++i)
+  {
+    char path[64] = {0};
+    sprintf(path, "./tmp_stream_%zu.bin", i);
+    ret &= write_file(path, data, sizes[i]);
+    fprintf(list, "./tmp_stream_%zu.bin ./tmp_stream_%zu.out %s\n", i, i, ivs[i]);
+    fprintf(cipher_list, "./tmp_stream_%zu.out ./tmp_stream_%zu.dec %s\n", i, i, ivs[i]);
+  }
+
+  fclose(list);
+  fclose(cipher_list);
+
+  char cmd[10240] = {0};
+  sprintf(cmd, "%s -e ./tmp_streams.txt -k %s -q --mode cbc --streams", des_bin_path, key_filename[1]);
+  printf("\n\nStreams %s \n\n", cmd);
+  system(cmd);
+
+  sprintf(cmd, "%s -d ./tmp_streams_cipher.txt -k %s -q --mode cbc --streams --engine bs64", des_bin_path, key_filename[1]);
+  printf("\n\nStreams %s \n\n", cmd);
+  system(cmd);
+
+  for(size_t i = 0; ret && i < STREAMS_NUM; ++i)
+  {
+    char path[64] = {0};
+    const size_t padded = (sizes[i] + 7) / 8 * 8;
+    char iv_line[32] = {0};
+    sprintf(iv_line, "%s\n", ivs[i]);
+    ret = write_file("./tmp_cbc_iv.txt", iv_line, strlen(iv_line));
+
+    sprintf(cmd, "%s -e ./tmp_stream_%zu.bin -k %s -o %s -q --mode cbc --iv ./tmp_cbc_iv.txt", des_bin_path, i, key_filename[1], tmp_bin_file_path);
+    system(cmd);
+
+    char *alone = NULL, *interleaved = NULL, *decrypted = NULL;
+    sprintf(path, "./tmp_stream_%zu.out", i);
+    ret = ret && read_whole_file(tmp_bin_file_path, &alone) == padded && read_whole_file(path, &interleaved) == padded && memcmp(alone, interleaved, padded) == 0;
+
+    sprintf(path, "./tmp_stream_%zu.dec", i);
+    ret = ret && read_whole_file(path, &decrypted) == padded && memcmp(decrypted, data, sizes[i]) == 0;
+
+    free(alone);
+    free(interleaved);
+    free(decrypted);
+  }
+
+  if(!ret)
+    printf("\n\n!!! STREAMS FAILED !!!\n\n");
+
+  for(size_t i = 0; i < STREAMS_NUM; ++i)
+  {
+    const char *suffixes[] = { "bin", "out", "dec" };
+    for(size_t j = 0; j < 3; ++j)
+    {
+      char path[64] = {0};
+      sprintf(path, "./tmp_stream_%zu.%s", i, suffixes[j]);
+      remove_file(path);
+    }
+  }
+
+  remove_file("./tmp_streams.txt");
+  remove_file("./tmp_streams_cipher.txt");
+  remove_file("./tmp_cbc_iv.txt");
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  Samples checked against the reference engine on the job threads and the
+ *  OFB keystream thread have to stay silent outside quiet mode too, only
+ *  the illustrated engine dumps blocks.
+ *
+ */
+
+static int verify_silent_test(const char *des_bin_path)
+{
+  const char *verify_data_path = "./tmp_verify_data.bin";
+  const char *verify_log_path = "./tmp_verify_log.txt";
+  const char *tmp_bin_file_path = "./tmp_file.bin";
+  const char *verify_iv = "0123456789ABCDEF\n";
+
+  unsigned char data[CTR_BYTES];
+  for(size_t i = 0; i < CTR_BYTES; ++i)
+    data[i] = (unsigned char)(i * 7 + 1);
+
+  int ret = write_file(verify_data_path, data, CTR_BYTES) && write_file("./tmp_verify_iv.txt", verify_iv, strlen(verify_iv));
+
+  const char *args[] = { "--engine table -j 4 --verify-sample 10", "--engine table --mode ofb --iv ./tmp_verify_iv.txt --verify-sample 5" };
+  for(size_t i = 0; ret && i < sizeof args / sizeof args[0]; ++i)
+  {
+    char cmd[10240] = {0};
+    sprintf(cmd, "%s -e %s -k %s -o %s %s > %s", des_bin_path, verify_data_path, key_filename[1], tmp_bin_file_path, args[i], verify_log_path);
+    printf("\n\nVerify %s \n\n", cmd);
+    ret = system(cmd) == 0;
+
+    FILE *log = fopen(verify_log_path, "r");
+    char line[1024];
+    while(ret && log && fgets(line, sizeof line, log))
+      ret = !strstr(line, "Cipher = ") && !strstr(line, "IP = ");
+
+    if(log)
+      fclose(log);
+  }
+
+  if(!ret)
+    printf("\n\n!!! VERIFY SILENT FAILED !!!\n\n");
+
+  remove_file(verify_data_path);
+  remove_file(verify_log_path);
+  remove_file("./tmp_verify_iv.txt");
+  remove_file(tmp_bin_file_path);
+
+  return ret;
+}
+
+/*
+ *
+ *  Fast paths against the reference engine, msg_crypt_block in quiet mode,
+ *  on blocks none of the vectors above have. The fast run also samples
+ *  every block against the reference itself with --verify-sample 1 and
+ *  has to finish cleanly, both directions.
+ *
+ */
+
+static void reference_blocks(unsigned seed, size_t blocks_num, unsigned char *msg)
+{
+  unsigned state = seed;
+  for(size_t i = 0; i < blocks_num * 8; ++i)
+  {
+    state = state * 1103515245u + 12345u;
+    msg[i] = (unsigned char)(state >> 16);
+  }
+}
+
+static int reference_test(const char *des_bin_path, const char *key_args, const unsigned char *msg, size_t blocks_num, const char *extra_args)
+{
+  const char *ref_data_path = "./tmp_ref_data.bin";
+  const char *ref_fast_path = "./tmp_ref_fast.bin";
+  const char *ref_slow_path = "./tmp_ref_slow.bin";
+
+  int ret = write_file(ref_data_path, msg, blocks_num * 8);
+  for(size_t op = 0; ret && op < 2; ++op)
+  {
+    char cmd[10240] = {0};
+    sprintf(cmd, "%s %s %s -k %s -o %s -q --verify-sample 1 %s", des_bin_path, op == 0 ? "-e" : "-d", ref_data_path, key_args, ref_fast_path, extra_args);
+    printf("\n\nReference %s \n\n", cmd);
+    ret = system(cmd) == 0;
+
+    sprintf(cmd, "%s %s %s -k %s -o %s -q --engine reference", des_bin_path, op == 0 ? "-e" : "-d", ref_data_path, key_args, ref_slow_path);
+    ret = ret && system(cmd) == 0;
+
+    char *fast = NULL, *slow = NULL;
+    ret = ret && read_whole_file(ref_fast_path, &fast) == blocks_num * 8 && read_whole_file(ref_slow_path, &slow) == blocks_num * 8;
+    ret = ret && memcmp(fast, slow, blocks_num * 8) == 0;
+
+    free(fast);
+    free(slow);
+  }
+
+  if(!ret)
+    printf("\n\n!!! REFERENCE FAILED !!!\n %s %s\n\n", key_args, extra_args);
+
+  remove_file(ref_data_path);
+  remove_file(ref_fast_path);
+  remove_file(ref_slow_path);
+
+  return ret;
+}
+
 int main(int argc, char **argv)
 {
   if(argc < 2)
@@ -86,7 +790,7 @@ int main(int argc, char **argv)
     if(!encrypt_bytes_read)
     {
       printf("Cant read from %s during ENCRYPT test\n", tmp_bin_file_path);
-      return 0;
+      return 1;
     } 
 
     const unsigned char *correct_encrypt_result = cipher[i];
@@ -96,7 +800,7 @@ int main(int argc, char **argv)
       {
         printf("\n\n!!! ENCRYPTING FAILED !!!\n %s\n\n", data_filename[i]);
         remove_file(tmp_bin_file_path);
-        return 0;
+        return 1;
       }
     }
 
@@ -110,7 +814,7 @@ int main(int argc, char **argv)
     if(!decrypt_bytes_read)
     {
       printf("Cant read from %s during DECRYPT test\n", tmp_bin_file_path);
-      return 0;
+      return 1;
     } 
 
     const unsigned char *correct_decrypt_result = data[i];
@@ -120,7 +824,7 @@ int main(int argc, char **argv)
       {
         printf("\n\n!!! DECRYPTING FAILED !!!\n %s\n\n", cipher_filename[i]);
         remove_file(tmp_bin_file_path);
-        return 0;
+        return 1;
       }
     }
 
@@ -144,7 +848,7 @@ int main(int argc, char **argv)
   if(!encrypt_bytes_read)
   {
     printf("Cant read from %s during ENCRYPT test\n", tmp_bin_file_path);
-    return 0;
+    return 1;
   } 
 
   const unsigned char *correct_encrypt_result = lewinski.cipher;
@@ -154,7 +858,7 @@ int main(int argc, char **argv)
     {
       printf("\n\n!!! ENCRYPTING FAILED !!!\n %s\n\n", lewinski.data_filename);
       remove_file(tmp_bin_file_path);
-      return 0;
+      return 1;
     }
   }
 
@@ -169,17 +873,17 @@ int main(int argc, char **argv)
   if(!decrypt_bytes_read)
   {
     printf("Cant read from %s during DECRYPT test\n", tmp_bin_file_path);
-    return 0;
+    return 1;
   } 
 
   const  char * const correct_decrypt_result = lewinski.data_not_padded;
-  for(size_t j = 0; j < decrypt_bytes_read && strlen(lewinski.data_not_padded); ++j)
+  for(size_t j = 0; j < decrypt_bytes_read && j < strlen(lewinski.data_not_padded); ++j)
   {
     if(correct_decrypt_result[j] != (unsigned char)file_content[j])
     {
       printf("\n\n!!! DECRYPTING FAILED !!!\n %s\n\n", lewinski.cipher_filename);
       remove_file(tmp_bin_file_path);
-      return 0;
+      return 1;
     }
   }
 
@@ -187,5 +891,116 @@ int main(int argc, char **argv)
  
   remove_file(tmp_bin_file_path);
 
-  return 0;
+  // every suite prints its own failure, the exit code tells the build
+  int failed = 0;
+  failed += !bulk_test(des_bin_path, "");
+  failed += !bulk_test(des_bin_path, "--verify-sample 3");
+  failed += !bulk_test(des_bin_path, "--trace-range 1023:1024");
+  failed += !bulk_test(des_bin_path, "--trace-format jsonl --trace-out /dev/null");
+  failed += !bulk_test(des_bin_path, "-j 3");
+  failed += !bulk_test(des_bin_path, "-j 4 --engine bs64 --verify-sample 5");
+  failed += !bulk_test(des_bin_path, "-j 4 --engine table --verify-sample 7");
+
+  // 3DES with K1 = K2 = K3 is single DES, EDE2 with K1 = K2 too
+  char ede_args[1024] = {0};
+  sprintf(ede_args, "-k %s -k %s", key_filename[1], key_filename[1]);
+  failed += !bulk_test(des_bin_path, ede_args);
+
+  sprintf(ede_args, "-k %s", key_filename[1]);
+  failed += !bulk_test(des_bin_path, ede_args);
+
+  failed += !ede_test(des_bin_path, "");
+  failed += !ede_test(des_bin_path, "-j 3 --verify-sample 5");
+
+  failed += !desx_test(des_bin_path);
+  failed += !sbox_test(des_bin_path);
+  failed += !ctr_test(des_bin_path);
+  failed += !cbc_test(des_bin_path);
+  failed += !streams_test(des_bin_path);
+  failed += !feedback_test(des_bin_path);
+  failed += !verify_silent_test(des_bin_path);
+
+  unsigned char ref_msg[1024 * 8];
+
+  // word datapath, the table engine, 13 blocks being three interleave groups and a tail
+  reference_blocks(1, 13, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 13, "--engine table");
+
+  // SP tables, 1024 blocks go 16384 times through each 64 entry table, the chance of missing an entry is below 1e-100
+  reference_blocks(2, 1024, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[1], ref_msg, 1024, "--engine table");
+
+  // IP and IP^-1 delta swaps, every single bit block walks each input bit through them, then a tail of five
+  memset(ref_msg, 0, 69 * 8);
+  for(size_t i = 0; i < 64; ++i)
+    ref_msg[i * 8 + i / 8] = (unsigned char)(0x80 >> i % 8);
+
+  reference_blocks(3, 5, ref_msg + 64 * 8);
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 69, "--engine table");
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 69, "--engine table4");
+
+  // key schedule tables, nibble p of key v is (v + p) % 16 so the 16 keys hit every position and value
+  reference_blocks(4, 13, ref_msg);
+  for(size_t v = 0; v < 16; ++v)
+  {
+    char ref_key[18] = {0};
+    for(size_t p = 0; p < 16; ++p)
+      ref_key[p] = "0123456789ABCDEF"[(v + p) % 16];
+
+    ref_key[16] = '\n';
+    failed += !(write_file("./tmp_ref_key.txt", ref_key, 17) && reference_test(des_bin_path, "./tmp_ref_key.txt", ref_msg, 13, "--engine table"));
+  }
+
+  remove_file("./tmp_ref_key.txt");
+
+  // unrolled encrypt and decrypt kernels, alone and alternating as the 3DES stages with three distinct keys
+  char ref_key_args[1024] = {0};
+  sprintf(ref_key_args, "%s -k %s -k ./tmp_ref_key.txt", key_filename[1], key_filename[0]);
+  reference_blocks(5, 13, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[3], ref_msg, 13, "--engine table");
+  failed += !(write_file("./tmp_ref_key.txt", "0123456789ABCDEF\n", 17) && reference_test(des_bin_path, ref_key_args, ref_msg, 13, "--engine table"));
+  remove_file("./tmp_ref_key.txt");
+
+  // bitsliced engine, three whole 64 block batches and a tail of 37 the table engine finishes
+  reference_blocks(6, 3 * 64 + 37, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 3 * 64 + 37, "--engine bs64");
+  failed += !reference_test(des_bin_path, key_filename[1], ref_msg, 3 * 64 + 37, "-j 2 --engine bs64");
+
+  // interleaved table kernel, four block groups and a tail of three
+  reference_blocks(7, 4 * 4 + 3, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 4 * 4 + 3, "--engine table4");
+
+  // paired 12 bit tables, 1024 blocks reach about 98% of each 4096 entry table, then interleave groups and a tail
+  reference_blocks(8, 1024, ref_msg);
+  failed += !reference_test(des_bin_path, key_filename[1], ref_msg, 1024, "--engine pair4");
+  failed += !reference_test(des_bin_path, key_filename[0], ref_msg, 4 * 4 + 3, "--engine pair4");
+
+  const char *engines[] = { "table4", "pair4", "bs64", "table", "reference" };
+  for(size_t i = 0; i < sizeof engines / sizeof engines[0]; ++i)
+  {
+    char engine_args[64] = {0};
+    sprintf(engine_args, "--engine %s", engines[i]);
+    failed += !bulk_test(des_bin_path, engine_args);
+    failed += !ede_test(des_bin_path, engine_args);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  if(__builtin_cpu_supports("avx2"))
+  {
+    failed += !bulk_test(des_bin_path, "--engine avx2");
+    failed += !bulk_test(des_bin_path, "--engine gather");
+    failed += !ede_test(des_bin_path, "--engine avx2");
+    failed += !ede_test(des_bin_path, "--engine gather");
+  }
+
+  if(__builtin_cpu_supports("avx512f"))
+  {
+    failed += !bulk_test(des_bin_path, "--engine avx512");
+    failed += !ede_test(des_bin_path, "--engine avx512");
+  }
+#endif
+
+  printf("\n\n%d suites failed\n", failed);
+
+  return failed ? 1 : 0;
 }